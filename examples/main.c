@@ -48,8 +48,9 @@ int main() {
             if (user_get_is_admin(username, &is_admin) == STATUS_OK && is_admin) {
                 printf("\nAdmin Options:\n");
                 printf("1. Add new user\n");
-                printf("2. Skip\n");
-                printf("Select an option (1-2): ");
+                printf("2. Remove user\n");
+                printf("3. Skip\n");
+                printf("Select an option (1-3): ");
 
                 char admin_choice[8];
                 if (fgets(admin_choice, sizeof(admin_choice), stdin)) {
@@ -94,6 +95,25 @@ int main() {
                         } else {
                             printf("Failed to add user. Status: %d\n", add_status);
                         }
+                    } else if (admin_choice[0] == '2') {
+                        char old_user[64];
+
+                        printf("Enter username to remove: ");
+                        if (!fgets(old_user, sizeof(old_user), stdin)) {
+                            printf("Input error.\n");
+                            continue;
+                        }
+                        size_t len = strnlen(old_user, sizeof(old_user));
+                        if (len > 0 && old_user[len - 1] == '\n') {
+                            old_user[len - 1] = '\0';
+                        }
+
+                        status_t remove_status = user_remove(old_user);
+                        if (remove_status == STATUS_OK) {
+                            printf("User removed successfully.\n");
+                        } else {
+                            printf("Failed to remove user. Status: %d\n", remove_status);
+                        }
                     }
                 }
             }
@@ -137,5 +157,6 @@ int main() {
         }
     }
 
+    locksys_shutdown();
     return 0;
 }
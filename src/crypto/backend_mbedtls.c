@@ -0,0 +1,51 @@
+//  Copyright 2025 Ross Kinard
+
+#include "crypto/crypto_backend.h"
+
+#if defined(CRYPTO_BACKEND_MBEDTLS)
+#include "extern/mbedtls/include/mbedtls/platform_util.h"
+#include <string.h>
+
+static void
+mbedtls_backend_resume(crypto_sha256_ctx_t* ctx, const uint32_t midstate[8], uint64_t prefix_len)
+{
+    mbedtls_sha256_init(&ctx->mbedtls);
+    mbedtls_sha256_starts_ret(&ctx->mbedtls, 0);
+    memcpy(ctx->mbedtls.state, midstate, sizeof(ctx->mbedtls.state));
+    ctx->mbedtls.total[0] = (uint32_t) prefix_len;
+    ctx->mbedtls.total[1] = (uint32_t) (prefix_len >> 32);
+}
+
+static void
+mbedtls_backend_update(crypto_sha256_ctx_t* ctx, const uint8_t* data, size_t len)
+{
+    mbedtls_sha256_update_ret(&ctx->mbedtls, data, len);
+}
+
+static void
+mbedtls_backend_final(crypto_sha256_ctx_t* ctx, uint8_t digest[32])
+{
+    mbedtls_sha256_finish_ret(&ctx->mbedtls, digest);
+    mbedtls_sha256_free(&ctx->mbedtls);
+}
+
+static void
+mbedtls_backend_midstate(const crypto_sha256_ctx_t* ctx, uint32_t out[8])
+{
+    // mbedTLS compresses a block as soon as it is complete
+    memcpy(out, ctx->mbedtls.state, sizeof(ctx->mbedtls.state));
+}
+
+const crypto_backend_t crypto_backend_mbedtls = {
+    .name      = "mbedtls",
+    .priority  = CRYPTO_PRIORITY_SOFTWARE + 1,
+    .supported = NULL,
+    .resume    = mbedtls_backend_resume,
+    .update    = mbedtls_backend_update,
+    .final     = mbedtls_backend_final,
+    .midstate  = mbedtls_backend_midstate,
+    .zeroize   = mbedtls_platform_zeroize,
+    .compare   = crypto_compare_generic,
+};
+
+#endif
@@ -0,0 +1,93 @@
+//  Copyright 2025 Ross Kinard
+
+#include "crypto/crypto_backend.h"
+
+#if defined(CONFIG_SHA256_ACCEL)
+#include "crypto/sha256_accel.h"
+#include <string.h>
+
+// Set by native_supported(), which selection always calls first
+static const sha256_accel_t* native_accel;
+
+static bool
+native_supported(void)
+{
+    native_accel = sha256_accel_probe();
+    return native_accel != NULL;
+}
+
+static void
+native_resume(crypto_sha256_ctx_t* ctx, const uint32_t midstate[8], uint64_t prefix_len)
+{
+    memcpy(ctx->native.state, midstate, sizeof(ctx->native.state));
+    ctx->native.total = prefix_len;
+    ctx->native.used  = 0;
+}
+
+static void
+native_update(crypto_sha256_ctx_t* ctx, const uint8_t* data, size_t len)
+{
+    crypto_sha256_native_t* s = &ctx->native;
+
+    s->total += len;
+    if (s->used > 0)
+    {
+        size_t take = sizeof(s->buffer) - s->used;
+
+        if (take > len)
+        {
+            take = len;
+        }
+        memcpy(s->buffer + s->used, data, take);
+        s->used += take;
+        data += take;
+        len -= take;
+        if (s->used < sizeof(s->buffer))
+        {
+            return;
+        }
+        native_accel->blocks(s->state, s->buffer, 1);
+        s->used = 0;
+    }
+
+    if (len >= 64)
+    {
+        native_accel->blocks(s->state, data, len / 64);
+        data += len - len % 64;
+        len %= 64;
+    }
+    if (len > 0)
+    {
+        memcpy(s->buffer, data, len);
+        s->used = len;
+    }
+}
+
+static void
+native_final(crypto_sha256_ctx_t* ctx, uint8_t digest[32])
+{
+    crypto_sha256_native_t* s = &ctx->native;
+
+    sha256_accel_finish(native_accel, s->state, s->total - s->used, s->buffer, s->used, digest);
+    crypto_zeroize_generic(s, sizeof(*s));
+}
+
+static void
+native_midstate(const crypto_sha256_ctx_t* ctx, uint32_t out[8])
+{
+    memcpy(out, ctx->native.state, sizeof(ctx->native.state));
+}
+
+const crypto_backend_t crypto_backend_native = {
+    .name      = "native",
+    .priority  = CRYPTO_PRIORITY_HARDWARE,
+    .supported = native_supported,
+    .resume    = native_resume,
+    .update    = native_update,
+    .final     = native_final,
+    .midstate  = native_midstate,
+    .zeroize   = crypto_zeroize_generic,
+    .compare   = crypto_compare_generic,
+};
+
+#endif
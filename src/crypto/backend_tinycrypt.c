@@ -0,0 +1,63 @@
+//  Copyright 2025 Ross Kinard
+
+#include "crypto/crypto_backend.h"
+
+#if defined(CRYPTO_BACKEND_TINYCRYPT)
+#include "extern/tinycrypt/include/tinycrypt/utils.h"
+
+static void
+tinycrypt_backend_resume(crypto_sha256_ctx_t* ctx, const uint32_t midstate[8],
+                         uint64_t prefix_len)
+{
+    tc_sha256_init(&ctx->tinycrypt);
+    for (size_t i = 0; i < 8; ++i)
+    {
+        ctx->tinycrypt.iv[i] = midstate[i];
+    }
+    ctx->tinycrypt.bits_hashed = prefix_len * 8;
+}
+
+static void
+tinycrypt_backend_update(crypto_sha256_ctx_t* ctx, const uint8_t* data, size_t len)
+{
+    if (len > 0)
+    {
+        tc_sha256_update(&ctx->tinycrypt, data, len);
+    }
+}
+
+static void
+tinycrypt_backend_final(crypto_sha256_ctx_t* ctx, uint8_t digest[32])
+{
+    tc_sha256_final(digest, &ctx->tinycrypt);
+}
+
+static void
+tinycrypt_backend_midstate(const crypto_sha256_ctx_t* ctx, uint32_t out[8])
+{
+    for (size_t i = 0; i < 8; ++i)
+    {
+        out[i] = (uint32_t) ctx->tinycrypt.iv[i];
+    }
+}
+
+static status_t
+tinycrypt_backend_compare(const uint8_t* a, const uint8_t* b, size_t len)
+{
+    return _compare(a, b, len) == 0 ? STATUS_OK : STATUS_ERR_AUTH;
+}
+
+// TinyCrypt's _set() is a plain memset, so zeroizing uses the generic loop
+const crypto_backend_t crypto_backend_tinycrypt = {
+    .name      = "tinycrypt",
+    .priority  = CRYPTO_PRIORITY_SOFTWARE,
+    .supported = NULL,
+    .resume    = tinycrypt_backend_resume,
+    .update    = tinycrypt_backend_update,
+    .final     = tinycrypt_backend_final,
+    .midstate  = tinycrypt_backend_midstate,
+    .zeroize   = crypto_zeroize_generic,
+    .compare   = tinycrypt_backend_compare,
+};
+
+#endif
@@ -2,110 +2,691 @@
 
 #include "crypto/crypto.h"
 
+#include "crypto/sha256_accel.h"
 #include "global/config.h"
 #include "hal/hal_storage.h"
 #include <string.h>
 
+#if defined(CRYPTO_BACKEND_MBEDTLS) && defined(MBEDTLS_PLATFORM_MEMORY)
+#include "extern/mbedtls/include/mbedtls/platform.h"
+#include <stdlib.h>
+#endif
+
+#define HMAC_SHA256_BLOCK_SIZE 64
+#define HMAC_SHA256_DIGEST_SIZE 32
+
+// Device-key schedule shared by every record, system-state and log MAC
+static hmac_sha256_key_t internal_key;
+
+// Backends linked into this image, in no particular order
+static const crypto_backend_t* const crypto_builtin_backends[] = {
+#if defined(CONFIG_SHA256_ACCEL)
+    &crypto_backend_native,
+#endif
 #if defined(CRYPTO_BACKEND_MBEDTLS)
-#include "extern/mbedtls/include/mbedtls/md.h"
-#include "extern/mbedtls/include/mbedtls/pkcs5.h"
-#include "extern/mbedtls/include/mbedtls/platform_util.h"
-#elif defined(CRYPTO_BACKEND_TINYCRYPT)
-#include "extern/tinycrypt/include/tinycrypt/constants.h"
-#include "extern/tinycrypt/include/tinycrypt/hmac.h"
-#include "extern/tinycrypt/include/tinycrypt/sha256.h"
-#else
-#error "No supported crypto backend defined"
+    &crypto_backend_mbedtls,
+#endif
+#if defined(CRYPTO_BACKEND_TINYCRYPT)
+    &crypto_backend_tinycrypt,
+#endif
+};
+static const crypto_backend_t* crypto_extra_backends[CRYPTO_MAX_EXTRA_BACKENDS];
+static size_t                  crypto_extra_count = 0;
+
+// Backend behind every MAC: the highest-priority one that is supported and
+// reproduces the known answers below. Chosen before the first key schedule;
+// key schedules are plain midstates, so they survive a later re-selection.
+static const crypto_backend_t* crypto_active   = NULL;
+static bool                    crypto_selected = false;
+
+#if defined(CONFIG_SHA256_ACCEL)
+// Multi-buffer SHA-256 behind batch MACs; NULL runs them one at a time
+static const sha256_multi_t* sha256_multi = NULL;
 #endif
 
+// Heap allocations made by linked crypto libraries (see crypto_alloc_count)
+static size_t crypto_allocs = 0;
+
+#if defined(CRYPTO_BACKEND_MBEDTLS) && defined(MBEDTLS_PLATFORM_MEMORY)
+static void*
+crypto_counting_calloc(size_t count, size_t size)
+{
+    ++crypto_allocs;
+    return calloc(count, size);
+}
+#endif
+
+static const uint32_t sha256_iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+// FIPS 180-2 appendix B and RFC 4231 test cases 2, 6 and 7; together they
+// cover empty, one- and two-block padding, multi-block input and hashed keys
+typedef struct
+{
+    const char* message;
+    uint8_t     digest[HMAC_SHA256_DIGEST_SIZE];
+} sha256_kat_t;
+
+typedef struct
+{
+    const char* key; // NULL: 131 bytes of 0xaa
+    const char* message;
+    uint8_t     mac[HMAC_SHA256_DIGEST_SIZE];
+} hmac_kat_t;
+
+static const sha256_kat_t sha256_kats[] = {
+    {"",
+     {0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14,
+      0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+      0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c,
+      0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55}},
+    {"abc",
+     {0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+      0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+      0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+      0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad}},
+    {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+     {0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8,
+      0xe5, 0xc0, 0x26, 0x93, 0x0c, 0x3e, 0x60, 0x39,
+      0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff, 0x21, 0x67,
+      0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1}},
+};
+
+static const hmac_kat_t hmac_kats[] = {
+    {"Jefe",
+     "what do ya want for nothing?",
+     {0x5b, 0xdc, 0xc1, 0x46, 0xbf, 0x60, 0x75, 0x4e,
+      0x6a, 0x04, 0x24, 0x26, 0x08, 0x95, 0x75, 0xc7,
+      0x5a, 0x00, 0x3f, 0x08, 0x9d, 0x27, 0x39, 0x83,
+      0x9d, 0xec, 0x58, 0xb9, 0x64, 0xec, 0x38, 0x43}},
+    {NULL,
+     "Test Using Larger Than Block-Size Key - Hash Key First",
+     {0x60, 0xe4, 0x31, 0x59, 0x1e, 0xe0, 0xb6, 0x7f,
+      0x0d, 0x8a, 0x26, 0xaa, 0xcb, 0xf5, 0xb7, 0x7f,
+      0x8e, 0x0b, 0xc6, 0x21, 0x37, 0x28, 0xc5, 0x14,
+      0x05, 0x46, 0x04, 0x0f, 0x0e, 0xe3, 0x7f, 0x54}},
+    {NULL,
+     "This is a test using a larger than block-size key and a larger than block-size data. The key "
+     "needs to be hashed before being used by the HMAC algorithm.",
+     {0x9b, 0x09, 0xff, 0xa7, 0x1b, 0x94, 0x2f, 0xcb,
+      0x27, 0x63, 0x5f, 0xbc, 0xd5, 0xb0, 0xe9, 0x44,
+      0xbf, 0xdc, 0x63, 0x64, 0x4f, 0x07, 0x13, 0x93,
+      0x8a, 0x7f, 0x51, 0x53, 0x5c, 0x3a, 0x35, 0xe2}},
+};
+
+void
+crypto_zeroize_generic(void* data, size_t len)
+{
+    volatile uint8_t* p = (volatile uint8_t*) data;
+    while (len--)
+        *p++ = 0;
+}
+
+status_t
+crypto_compare_generic(const uint8_t* a, const uint8_t* b, size_t len)
+{
+    status_t status = STATUS_ERR_UNINITIALIZED;
+    uint8_t  diff   = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        diff |= a[i] ^ b[i];
+    }
+
+    if (0 == diff)
+    {
+        status = STATUS_OK;
+    }
+    else
+    {
+        status = STATUS_ERR_AUTH;
+    }
+    return status;
+}
+
 /**
- * secure_zero() wraps mbedtls_platform_zeroize() to securely erase memory.
- * This prevents the compiler from optimizing away memory clearing of sensitive
- * data, such as PINs or cryptographic keys.
+ * secure_zero() erases memory through the active backend's zeroize, which
+ * the compiler cannot optimize away, so PINs and key material do not
+ * linger. Before a backend is chosen the generic volatile loop is used.
  */
 status_t
 secure_zero(void* data, size_t len)
 {
-#if defined(CRYPTO_BACKEND_MBEDTLS)
-    mbedtls_platform_zeroize(data, len);
-#elif defined(CRYPTO_BACKEND_TINYCRYPT)
-    volatile uint8_t* p = (volatile uint8_t*) data;
-    while (len--)
-        *p++ = 0;
-#else
-    return STATUS_ERR_INTERNAL;
-#endif
+    if (crypto_active)
+    {
+        crypto_active->zeroize(data, len);
+    }
+    else
+    {
+        crypto_zeroize_generic(data, len);
+    }
     return STATUS_OK;
 }
 
 status_t
-get_hmac_sha256(const uint8_t* key, size_t key_len, const uint8_t* input, size_t input_len,
-                uint8_t* output)
+secure_compare(const uint8_t* a, const uint8_t* b, size_t len)
 {
-#if defined(CRYPTO_BACKEND_MBEDTLS)
-    const mbedtls_md_info_t* md_info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
-    if (!md_info)
+    return crypto_active ? crypto_active->compare(a, b, len) : crypto_compare_generic(a, b, len);
+}
+
+static void
+sha256_with(const crypto_backend_t* backend, const uint8_t* data, size_t len, uint8_t* digest)
+{
+    crypto_sha256_ctx_t ctx;
+
+    backend->resume(&ctx, sha256_iv, 0);
+    backend->update(&ctx, data, len);
+    backend->final(&ctx, digest);
+}
+
+static status_t
+hmac_key_schedule(const crypto_backend_t* backend, hmac_sha256_key_t* ctx, const uint8_t* key,
+                  size_t key_len)
+{
+    crypto_sha256_ctx_t sha;
+    uint8_t             block[HMAC_SHA256_BLOCK_SIZE];
+
+    if (!ctx || (!key && key_len > 0))
+    {
+        return STATUS_ERR_INPUT;
+    }
+
+    memset(ctx, 0, sizeof(*ctx));
+    if (!backend)
     {
         return STATUS_ERR_INTERNAL;
     }
-    if (mbedtls_md_hmac(md_info, key, key_len, input, input_len, output) != 0)
+
+    memset(block, 0, sizeof(block));
+    if (key_len > HMAC_SHA256_BLOCK_SIZE)
+    {
+        sha256_with(backend, key, key_len, block);
+    }
+    else if (key_len > 0)
+    {
+        memcpy(block, key, key_len);
+    }
+
+    for (size_t i = 0; i < sizeof(block); ++i)
+    {
+        block[i] ^= 0x36;
+    }
+    backend->resume(&sha, sha256_iv, 0);
+    backend->update(&sha, block, sizeof(block));
+    backend->midstate(&sha, ctx->inner_state);
+
+    for (size_t i = 0; i < sizeof(block); ++i)
+    {
+        block[i] ^= 0x36 ^ 0x5c;
+    }
+    backend->resume(&sha, sha256_iv, 0);
+    backend->update(&sha, block, sizeof(block));
+    backend->midstate(&sha, ctx->outer_state);
+
+    backend->zeroize(&sha, sizeof(sha));
+    backend->zeroize(block, sizeof(block));
+    ctx->ready = true;
+
+    return STATUS_OK;
+}
+
+static status_t
+hmac_begin(const crypto_backend_t* backend, hmac_sha256_ctx_t* ctx, const hmac_sha256_key_t* key)
+{
+    if (!ctx || !key || !key->ready)
+    {
+        return STATUS_ERR_INPUT;
+    }
+    if (!backend)
     {
         return STATUS_ERR_INTERNAL;
     }
+
+    ctx->backend = backend;
+    memcpy(ctx->outer_state, key->outer_state, sizeof(ctx->outer_state));
+    backend->resume(&ctx->sha, key->inner_state, HMAC_SHA256_BLOCK_SIZE);
+
     return STATUS_OK;
+}
 
-#elif defined(CRYPTO_BACKEND_TINYCRYPT)
-    struct tc_hmac_state_struct state;
+static status_t
+hmac_keyed_with(const crypto_backend_t* backend, const hmac_sha256_key_t* key,
+                const uint8_t* input, size_t input_len, uint8_t* output)
+{
+    hmac_sha256_ctx_t ctx;
+    status_t          status = STATUS_OK;
 
-    if (tc_hmac_set_key(&state, key, key_len) != TC_CRYPTO_SUCCESS)
+    if (!output || (!input && input_len > 0))
     {
-        secure_zero(&state, sizeof(state));
-        return STATUS_ERR_INTERNAL;
+        return STATUS_ERR_INPUT;
     }
 
-    if (tc_hmac_init(&state) != TC_CRYPTO_SUCCESS)
+    status = hmac_begin(backend, &ctx, key);
+    if (STATUS_OK == status)
     {
-        secure_zero(&state, sizeof(state));
-        return STATUS_ERR_INTERNAL;
+        hmac_sha256_update(&ctx, input, input_len);
+        status = hmac_sha256_final(&ctx, output);
     }
 
-    if (tc_hmac_update(&state, input, input_len) != TC_CRYPTO_SUCCESS)
+    return status;
+}
+
+#if defined(CONFIG_SHA256_ACCEL)
+static status_t
+hmac_many_with(const sha256_multi_t* multi, const hmac_sha256_key_t* ctx,
+               const uint8_t* const* inputs, size_t input_len, uint8_t* const* outputs,
+               size_t count)
+{
+    const uint8_t* lane_in[SHA256_MAX_LANES];
+    uint8_t*       lane_out[SHA256_MAX_LANES];
+    uint8_t        inner[SHA256_MAX_LANES][HMAC_SHA256_DIGEST_SIZE];
+    uint8_t        spare[SHA256_MAX_LANES][HMAC_SHA256_DIGEST_SIZE];
+    uint8_t*       inner_out[SHA256_MAX_LANES];
+
+    for (size_t base = 0; base < count; base += multi->lanes)
     {
-        secure_zero(&state, sizeof(state));
-        return STATUS_ERR_INTERNAL;
+        // A short last batch repeats its first input into spare outputs
+        for (size_t l = 0; l < multi->lanes; ++l)
+        {
+            bool used    = base + l < count;
+            lane_in[l]   = inputs[used ? base + l : base];
+            lane_out[l]  = used ? outputs[base + l] : spare[l];
+            inner_out[l] = inner[l];
+        }
+
+        sha256_multi_finish(multi, ctx->inner_state, HMAC_SHA256_BLOCK_SIZE, lane_in, input_len,
+                            inner_out);
+        sha256_multi_finish(multi, ctx->outer_state, HMAC_SHA256_BLOCK_SIZE,
+                            (const uint8_t* const*) inner_out, HMAC_SHA256_DIGEST_SIZE, lane_out);
+    }
+
+    secure_zero(inner, sizeof(inner));
+    secure_zero(spare, sizeof(spare));
+    return STATUS_OK;
+}
+#endif
+
+static status_t
+self_test_backend(const crypto_backend_t* backend)
+{
+    status_t          status = STATUS_OK;
+    hmac_sha256_key_t ctx;
+    hmac_sha256_ctx_t stream;
+    uint8_t           long_key[131];
+    uint8_t           digest[HMAC_SHA256_DIGEST_SIZE];
+
+    memset(long_key, 0xaa, sizeof(long_key));
+
+    for (size_t i = 0; STATUS_OK == status && i < sizeof(sha256_kats) / sizeof(sha256_kats[0]); ++i)
+    {
+        sha256_with(backend, (const uint8_t*) sha256_kats[i].message,
+                    strlen(sha256_kats[i].message), digest);
+        if (memcmp(digest, sha256_kats[i].digest, sizeof(digest)) != 0)
+        {
+            status = STATUS_ERR_INTERNAL;
+        }
     }
 
-    if (tc_hmac_final(output, TC_SHA256_DIGEST_SIZE, &state) != TC_CRYPTO_SUCCESS)
+    for (size_t i = 0; STATUS_OK == status && i < sizeof(hmac_kats) / sizeof(hmac_kats[0]); ++i)
     {
-        secure_zero(&state, sizeof(state));
-        return STATUS_ERR_INTERNAL;
+        const hmac_kat_t* kat = &hmac_kats[i];
+
+        status = kat->key ? hmac_key_schedule(backend, &ctx, (const uint8_t*) kat->key,
+                                              strlen(kat->key))
+                          : hmac_key_schedule(backend, &ctx, long_key, sizeof(long_key));
+        if (STATUS_OK == status)
+        {
+            status = hmac_keyed_with(backend, &ctx, (const uint8_t*) kat->message,
+                                     strlen(kat->message), digest);
+        }
+        if (STATUS_OK == status && memcmp(digest, kat->mac, sizeof(digest)) != 0)
+        {
+            status = STATUS_ERR_INTERNAL;
+        }
+
+        // Again in uneven pieces, so partial blocks are carried between updates
+        if (STATUS_OK == status)
+        {
+            const uint8_t* msg = (const uint8_t*) kat->message;
+            size_t         len = strlen(kat->message);
+
+            status = hmac_begin(backend, &stream, &ctx);
+            if (STATUS_OK == status)
+            {
+                hmac_sha256_update(&stream, msg, 1);
+                hmac_sha256_update(&stream, msg + 1, len / 2);
+                hmac_sha256_update(&stream, msg + 1 + len / 2, len - 1 - len / 2);
+                status = hmac_sha256_final(&stream, digest);
+            }
+        }
+        if (STATUS_OK == status && memcmp(digest, kat->mac, sizeof(digest)) != 0)
+        {
+            status = STATUS_ERR_INTERNAL;
+        }
+        crypto_zeroize_generic(&ctx, sizeof(ctx));
+    }
+
+    return status;
+}
+
+#if defined(CONFIG_SHA256_ACCEL)
+// Known answers in every lane, then distinct messages per lane checked
+// against the chosen backend so a lane mix-up cannot pass
+static status_t
+self_test_lanes(const crypto_backend_t* backend, const sha256_multi_t* multi)
+{
+    status_t          status = STATUS_OK;
+    hmac_sha256_key_t ctx;
+    const uint8_t*    inputs[SHA256_MAX_LANES + 1];
+    uint8_t*          outputs[SHA256_MAX_LANES + 1];
+    uint8_t           digests[SHA256_MAX_LANES + 1][HMAC_SHA256_DIGEST_SIZE];
+    uint8_t           messages[SHA256_MAX_LANES + 1][100];
+    uint8_t           expected[HMAC_SHA256_DIGEST_SIZE];
+    size_t            count = multi->lanes + 1; // One full batch and one padded
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        outputs[i] = digests[i];
+    }
+
+    for (size_t k = 0; STATUS_OK == status && k < sizeof(sha256_kats) / sizeof(sha256_kats[0]); ++k)
+    {
+        for (size_t i = 0; i < multi->lanes; ++i)
+        {
+            inputs[i] = (const uint8_t*) sha256_kats[k].message;
+        }
+        sha256_multi_finish(multi, sha256_iv, 0, inputs, strlen(sha256_kats[k].message), outputs);
+        for (size_t i = 0; STATUS_OK == status && i < multi->lanes; ++i)
+        {
+            if (memcmp(digests[i], sha256_kats[k].digest, HMAC_SHA256_DIGEST_SIZE) != 0)
+            {
+                status = STATUS_ERR_INTERNAL;
+            }
+        }
+    }
+
+    if (STATUS_OK == status)
+    {
+        status = hmac_key_schedule(backend, &ctx, (const uint8_t*) hmac_kats[0].key,
+                                   strlen(hmac_kats[0].key));
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (size_t j = 0; j < sizeof(messages[i]); ++j)
+        {
+            messages[i][j] = (uint8_t) (i * 31 + j);
+        }
+        inputs[i] = messages[i];
+    }
+    if (STATUS_OK == status)
+    {
+        status = hmac_many_with(multi, &ctx, inputs, sizeof(messages[0]), outputs, count);
+    }
+    for (size_t i = 0; STATUS_OK == status && i < count; ++i)
+    {
+        status = hmac_keyed_with(backend, &ctx, messages[i], sizeof(messages[i]), expected);
+        if (STATUS_OK == status && memcmp(digests[i], expected, sizeof(expected)) != 0)
+        {
+            status = STATUS_ERR_INTERNAL;
+        }
+    }
+
+    crypto_zeroize_generic(&ctx, sizeof(ctx));
+    return status;
+}
+#endif
+
+static bool
+crypto_candidate(const crypto_backend_t* backend, const crypto_backend_t* best)
+{
+    return (!backend->supported || backend->supported()) &&
+           STATUS_OK == self_test_backend(backend) &&
+           (!best || backend->priority > best->priority);
+}
+
+// Settles which backend, and which batch lanes, the MACs use
+static void
+crypto_select(void)
+{
+    const crypto_backend_t* best = NULL;
+
+    if (crypto_selected)
+    {
+        return;
+    }
+
+#if defined(CRYPTO_BACKEND_MBEDTLS) && defined(MBEDTLS_PLATFORM_MEMORY)
+    mbedtls_platform_set_calloc_free(crypto_counting_calloc, free);
+#endif
+
+    // Every linked backend runs its known answers, not just the winner
+    for (size_t i = 0; i < sizeof(crypto_builtin_backends) / sizeof(crypto_builtin_backends[0]);
+         ++i)
+    {
+        if (crypto_candidate(crypto_builtin_backends[i], best))
+        {
+            best = crypto_builtin_backends[i];
+        }
+    }
+    for (size_t i = 0; i < crypto_extra_count; ++i)
+    {
+        if (crypto_candidate(crypto_extra_backends[i], best))
+        {
+            best = crypto_extra_backends[i];
+        }
+    }
+    crypto_active = best;
+
+#if defined(CONFIG_SHA256_ACCEL)
+    const sha256_multi_t* multi = sha256_multi_probe();
+
+#if !defined(CONFIG_SHA256_LANES_WITH_HARDWARE)
+    // Measured at -O2 the lanes only trade places with SHA-NI
+    if (best && best->priority >= CRYPTO_PRIORITY_HARDWARE)
+    {
+        multi = NULL;
+    }
+#endif
+    sha256_multi = (best && multi && STATUS_OK == self_test_lanes(best, multi)) ? multi : NULL;
+#endif
+    crypto_selected = true;
+}
+
+status_t
+crypto_register_backend(const crypto_backend_t* backend)
+{
+    if (!backend || !backend->resume || !backend->update || !backend->final ||
+        !backend->midstate || !backend->zeroize || !backend->compare)
+    {
+        return STATUS_ERR_INPUT;
+    }
+    if (crypto_extra_count >= CRYPTO_MAX_EXTRA_BACKENDS)
+    {
+        return STATUS_ERR_FULL;
+    }
+
+    crypto_extra_backends[crypto_extra_count++] = backend;
+    crypto_selected                             = false; // Reconsidered on next use
+
+    return STATUS_OK;
+}
+
+status_t
+crypto_self_test(void)
+{
+    crypto_selected = false;
+    crypto_select();
+
+    return crypto_active ? STATUS_OK : STATUS_ERR_INTERNAL;
+}
+
+size_t
+crypto_alloc_count(void)
+{
+    return crypto_allocs;
+}
+
+const char*
+crypto_backend_name(void)
+{
+    crypto_select();
+    return crypto_active ? crypto_active->name : "none";
+}
+
+status_t
+get_hmac_sha256(const uint8_t* key, size_t key_len, const uint8_t* input, size_t input_len,
+                uint8_t* output)
+{
+    hmac_sha256_key_t ctx;
+    status_t          status = hmac_sha256_key_init(&ctx, key, key_len);
+
+    if (STATUS_OK == status)
+    {
+        status = hmac_sha256_keyed(&ctx, input, input_len, output);
+    }
+    hmac_sha256_key_zeroize(&ctx);
+
+    return status;
+}
+
+status_t
+hmac_sha256_key_init(hmac_sha256_key_t* ctx, const uint8_t* key, size_t key_len)
+{
+    crypto_select();
+    return hmac_key_schedule(crypto_active, ctx, key, key_len);
+}
+
+status_t
+hmac_sha256_keyed(const hmac_sha256_key_t* ctx, const uint8_t* input, size_t input_len,
+                  uint8_t* output)
+{
+    crypto_select();
+    return hmac_keyed_with(crypto_active, ctx, input, input_len, output);
+}
+
+status_t
+hmac_sha256_init(hmac_sha256_ctx_t* ctx, const hmac_sha256_key_t* key)
+{
+    crypto_select();
+    return hmac_begin(crypto_active, ctx, key);
+}
+
+status_t
+hmac_sha256_update(hmac_sha256_ctx_t* ctx, const uint8_t* data, size_t len)
+{
+    if (!ctx || !ctx->backend || (!data && len > 0))
+    {
+        return STATUS_ERR_INPUT;
+    }
+
+    ctx->backend->update(&ctx->sha, data, len);
+    return STATUS_OK;
+}
+
+status_t
+hmac_sha256_final(hmac_sha256_ctx_t* ctx, uint8_t* output)
+{
+    const crypto_backend_t* backend = ctx ? ctx->backend : NULL;
+    uint8_t                 inner_hash[HMAC_SHA256_DIGEST_SIZE];
+
+    if (!backend || !output)
+    {
+        return STATUS_ERR_INPUT;
     }
 
-    secure_zero(&state, sizeof(state));
+    backend->final(&ctx->sha, inner_hash);
+    backend->resume(&ctx->sha, ctx->outer_state, HMAC_SHA256_BLOCK_SIZE);
+    backend->update(&ctx->sha, inner_hash, sizeof(inner_hash));
+    backend->final(&ctx->sha, output);
+
+    backend->zeroize(inner_hash, sizeof(inner_hash));
+    backend->zeroize(ctx, sizeof(*ctx));
+
     return STATUS_OK;
-#else
-    return STATUS_ERR_INTERNAL;
+}
+
+status_t
+hmac_sha256_keyed_many(const hmac_sha256_key_t* ctx, const uint8_t* const* inputs,
+                       size_t input_len, uint8_t* const* outputs, size_t count)
+{
+    status_t status = STATUS_OK;
+
+    if (!ctx || !ctx->ready || (count > 0 && (!inputs || !outputs)))
+    {
+        return STATUS_ERR_INPUT;
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!outputs[i] || (!inputs[i] && input_len > 0))
+        {
+            return STATUS_ERR_INPUT;
+        }
+    }
+
+    crypto_select();
+#if defined(CONFIG_SHA256_ACCEL)
+    // Only set when the lanes are worth it over the active backend
+    if (sha256_multi && count > 1)
+    {
+        return hmac_many_with(sha256_multi, ctx, inputs, input_len, outputs, count);
+    }
 #endif
+
+    for (size_t i = 0; STATUS_OK == status && i < count; ++i)
+    {
+        status = hmac_sha256_keyed(ctx, inputs[i], input_len, outputs[i]);
+    }
+
+    return status;
 }
 
 status_t
-secure_compare(const uint8_t* a, const uint8_t* b, size_t len)
+hmac_sha256_key_zeroize(hmac_sha256_key_t* ctx)
 {
-    status_t status = STATUS_ERR_UNINITIALIZED;
-    uint8_t  diff   = 0;
-    for (size_t i = 0; i < len; i++)
+    if (!ctx)
     {
-        diff |= a[i] ^ b[i];
+        return STATUS_ERR_INPUT;
     }
 
-    if (0 == diff)
+    return secure_zero(ctx, sizeof(*ctx));
+}
+
+status_t
+crypto_release_internal_key(void)
+{
+    return hmac_sha256_key_zeroize(&internal_key);
+}
+
+// Derive the device-key schedule on first use
+static status_t
+internal_key_load(void)
+{
+    status_t status = STATUS_OK;
+
+    if (!internal_key.ready)
     {
-        status = STATUS_OK;
+        uint8_t device_key[DEVICE_KEY_LEN];
+
+        status = hal_load_device_key(device_key, sizeof(device_key));
+        if (STATUS_OK == status)
+        {
+            status = hmac_sha256_key_init(&internal_key, device_key, DEVICE_KEY_LEN);
+        }
+        secure_zero(device_key, sizeof(device_key));
     }
-    else
+
+    return status;
+}
+
+status_t
+compute_internal_hmac_init(hmac_sha256_ctx_t* ctx)
+{
+    status_t status = internal_key_load();
+
+    if (STATUS_OK == status)
     {
-        status = STATUS_ERR_AUTH;
+        status = hmac_sha256_init(ctx, &internal_key);
     }
+
     return status;
 }
 
@@ -113,7 +694,6 @@ status_t
 compute_internal_hmac(const uint8_t* data, size_t data_len, uint8_t* out_mac, size_t out_len)
 {
     status_t status = STATUS_ERR_UNINITIALIZED;
-    uint8_t  device_key[DEVICE_KEY_LEN];
 
     if (out_len < LOCKSYS_HASH_SIZE)
     {
@@ -121,15 +701,14 @@ compute_internal_hmac(const uint8_t* data, size_t data_len, uint8_t* out_mac, si
     }
     else
     {
-        status = hal_load_device_key(device_key, sizeof(device_key));
+        status = internal_key_load();
     }
 
     if (STATUS_OK == status)
     {
-        status = get_hmac_sha256(device_key, DEVICE_KEY_LEN, data, data_len, out_mac);
+        status = hmac_sha256_keyed(&internal_key, data, data_len, out_mac);
     }
 
-    secure_zero(device_key, sizeof(device_key));
     if (STATUS_OK != status)
     {
         memset(out_mac, 0, out_len);
@@ -137,3 +716,28 @@ compute_internal_hmac(const uint8_t* data, size_t data_len, uint8_t* out_mac, si
 
     return status;
 }
+
+status_t
+compute_internal_hmac_many(const uint8_t* const* inputs, size_t input_len, uint8_t* const* outputs,
+                           size_t count)
+{
+    status_t status = internal_key_load();
+
+    if (STATUS_OK == status)
+    {
+        status = hmac_sha256_keyed_many(&internal_key, inputs, input_len, outputs, count);
+    }
+
+    if (STATUS_OK != status && outputs)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (outputs[i])
+            {
+                memset(outputs[i], 0, LOCKSYS_HASH_SIZE);
+            }
+        }
+    }
+
+    return status;
+}
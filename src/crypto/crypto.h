@@ -3,11 +3,35 @@
 #ifndef INCLUDE_CRYPTO_H_
 #define INCLUDE_CRYPTO_H_
 
+#include "crypto/crypto_backend.h"
 #include "global/common.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+/**
+ * HMAC-SHA256 key schedule: SHA-256 midstates after absorbing the
+ * ipad and opad key blocks. Plain words, so any backend can resume from
+ * them. Holds key-derived secrets; zeroize when done.
+ */
+typedef struct
+{
+    uint32_t inner_state[8];
+    uint32_t outer_state[8];
+    bool     ready;
+} hmac_sha256_key_t;
+
+/**
+ * Incremental HMAC-SHA256 from a key schedule, for input that is not
+ * contiguous in memory. Holds key-derived state; final wipes it.
+ */
+typedef struct
+{
+    crypto_sha256_ctx_t     sha;
+    uint32_t                outer_state[8];
+    const crypto_backend_t* backend;
+} hmac_sha256_ctx_t;
+
 /**
  * Securely zero memory to remove secrets.
  */
@@ -21,9 +45,102 @@ status_t
 get_hmac_sha256(const uint8_t* key, size_t key_len, const uint8_t* input, size_t input_len,
                 uint8_t* output);
 
+/**
+ * Precompute the inner/outer midstates for a key.
+ */
+status_t
+hmac_sha256_key_init(hmac_sha256_key_t* ctx, const uint8_t* key, size_t key_len);
+
+/**
+ * Compute HMAC-SHA256 from a precomputed key schedule.
+ */
+status_t
+hmac_sha256_keyed(const hmac_sha256_key_t* ctx, const uint8_t* input, size_t input_len,
+                  uint8_t* output);
+
+/**
+ * Streaming form of hmac_sha256_keyed(): init, any number of updates, then
+ * final, which writes the 32-byte MAC and wipes ctx. The key schedule may
+ * be zeroized once init returns.
+ */
+status_t
+hmac_sha256_init(hmac_sha256_ctx_t* ctx, const hmac_sha256_key_t* key);
+
+status_t
+hmac_sha256_update(hmac_sha256_ctx_t* ctx, const uint8_t* data, size_t len);
+
+status_t
+hmac_sha256_final(hmac_sha256_ctx_t* ctx, uint8_t* output);
+
+/**
+ * hmac_sha256_keyed() over count inputs of the same length; outputs[i]
+ * receives the MAC of inputs[i]. Several inputs are hashed per pass when the
+ * CPU offers a multi-buffer SHA-256 and the active backend is a software
+ * one (see CONFIG_SHA256_LANES_WITH_HARDWARE).
+ */
+status_t
+hmac_sha256_keyed_many(const hmac_sha256_key_t* ctx, const uint8_t* const* inputs,
+                       size_t input_len, uint8_t* const* outputs, size_t count);
+
+status_t
+hmac_sha256_key_zeroize(hmac_sha256_key_t* ctx);
+
+/**
+ * HMAC with the device key. The key schedule is derived on first use and
+ * cached; crypto_release_internal_key() wipes it.
+ */
 status_t
 compute_internal_hmac(const uint8_t* input, size_t input_len, uint8_t* output, size_t out_len);
 
+/**
+ * Start a streaming MAC with the device key; continue with
+ * hmac_sha256_update() and hmac_sha256_final().
+ */
+status_t
+compute_internal_hmac_init(hmac_sha256_ctx_t* ctx);
+
+/**
+ * Batch form of compute_internal_hmac() for equal-length inputs, such as a
+ * sweep over stored records; each outputs[i] holds LOCKSYS_HASH_SIZE bytes.
+ */
+status_t
+compute_internal_hmac_many(const uint8_t* const* inputs, size_t input_len, uint8_t* const* outputs,
+                           size_t count);
+
+status_t
+crypto_release_internal_key(void);
+
+/**
+ * Add a backend (e.g. a board's hash engine) to those linked into the
+ * image. Call before locksys_init(); the next MAC re-runs selection.
+ */
+status_t
+crypto_register_backend(const crypto_backend_t* backend);
+
+/**
+ * Run SHA-256 and HMAC-SHA256 known answers through every linked backend
+ * the hardware supports and make the highest-priority one that passes the
+ * active backend. Fails only when none passes.
+ */
+status_t
+crypto_self_test(void);
+
+/**
+ * Allocations made through mbedTLS's allocator hook since boot. Only builds
+ * that define MBEDTLS_PLATFORM_MEMORY install the hook; the native and
+ * TinyCrypt backends never allocate and are not counted. MACs keep all
+ * hashing state on the stack or in statics, so tests can sample this around
+ * an unlock and expect it unchanged.
+ */
+size_t
+crypto_alloc_count(void);
+
+/**
+ * Name of the backend in use, selecting one first if needed.
+ */
+const char*
+crypto_backend_name(void);
+
 /**
  * Compare two memory regions in constant time.
  */
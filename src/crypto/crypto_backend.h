@@ -0,0 +1,92 @@
+//  Copyright 2025 Ross Kinard
+
+#ifndef INCLUDE_CRYPTO_BACKEND_H_
+#define INCLUDE_CRYPTO_BACKEND_H_
+
+#include "global/common.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(CRYPTO_BACKEND_MBEDTLS)
+#include "extern/mbedtls/include/mbedtls/sha256.h"
+#endif
+#if defined(CRYPTO_BACKEND_TINYCRYPT)
+#include "extern/tinycrypt/include/tinycrypt/sha256.h"
+#endif
+
+// Selection order among backends that pass the self-test; highest wins
+#define CRYPTO_PRIORITY_SOFTWARE 10
+#define CRYPTO_PRIORITY_HARDWARE 100
+
+// Backends linked in beyond the built-in ones (see crypto_register_backend)
+#define CRYPTO_MAX_EXTRA_BACKENDS 2
+
+typedef struct
+{
+    uint32_t state[8];
+    uint64_t total; // Bytes absorbed, including those in buffer
+    uint8_t  buffer[64];
+    size_t   used;
+} crypto_sha256_native_t;
+
+/**
+ * SHA-256 state in whatever form the owning backend keeps it.
+ */
+typedef union
+{
+#if defined(CRYPTO_BACKEND_MBEDTLS)
+    mbedtls_sha256_context mbedtls;
+#endif
+#if defined(CRYPTO_BACKEND_TINYCRYPT)
+    struct tc_sha256_state_struct tinycrypt;
+#endif
+    crypto_sha256_native_t native;
+} crypto_sha256_ctx_t;
+
+/**
+ * One SHA-256 implementation. HMAC, key schedules and the known-answer
+ * self-test are built in crypto.c on these operations, so a backend only
+ * supplies hashing that can resume from a raw midstate.
+ */
+typedef struct
+{
+    const char* name;
+    uint8_t     priority;
+
+    // Whether this CPU / board can run the backend at all; may be NULL
+    bool (*supported)(void);
+
+    // Start hashing as if prefix_len bytes (a multiple of 64) had already
+    // produced midstate
+    void (*resume)(crypto_sha256_ctx_t* ctx, const uint32_t midstate[8], uint64_t prefix_len);
+    void (*update)(crypto_sha256_ctx_t* ctx, const uint8_t* data, size_t len);
+    // Write the digest and wipe ctx
+    void (*final)(crypto_sha256_ctx_t* ctx, uint8_t digest[32]);
+    // Current midstate; only called after a multiple of 64 bytes
+    void (*midstate)(const crypto_sha256_ctx_t* ctx, uint32_t out[8]);
+
+    void (*zeroize)(void* data, size_t len);
+    status_t (*compare)(const uint8_t* a, const uint8_t* b, size_t len);
+} crypto_backend_t;
+
+#if defined(CRYPTO_BACKEND_MBEDTLS)
+extern const crypto_backend_t crypto_backend_mbedtls;
+#endif
+#if defined(CRYPTO_BACKEND_TINYCRYPT)
+extern const crypto_backend_t crypto_backend_tinycrypt;
+#endif
+#if defined(CONFIG_SHA256_ACCEL)
+extern const crypto_backend_t crypto_backend_native;
+#endif
+
+/**
+ * Plain C zeroize / constant-time compare for backends without their own.
+ */
+void
+crypto_zeroize_generic(void* data, size_t len);
+
+status_t
+crypto_compare_generic(const uint8_t* a, const uint8_t* b, size_t len);
+
+#endif //  INCLUDE_CRYPTO_BACKEND_H_
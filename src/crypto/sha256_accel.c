@@ -0,0 +1,387 @@
+//  Copyright 2025 Ross Kinard
+
+#include "crypto/sha256_accel.h"
+
+#include "crypto/crypto.h"
+#include <string.h>
+
+// Only GCC-compatible compilers: the kernels rely on per-function target
+// attributes so the rest of the build keeps its baseline instruction set.
+#if defined(CONFIG_SHA256_ACCEL) && defined(__GNUC__) &&                                            \
+    (defined(__x86_64__) || defined(__i386__))
+#define SHA256_ACCEL_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#elif defined(CONFIG_SHA256_ACCEL) && defined(__GNUC__) && defined(__aarch64__)
+#define SHA256_ACCEL_ARMV8
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
+#if defined(SHA256_ACCEL_X86) || defined(SHA256_ACCEL_ARMV8)
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+#endif
+
+#if defined(SHA256_ACCEL_X86)
+// Each loop pass runs four rounds and, for the first twelve, extends the
+// message schedule by the four words needed twelve rounds later.
+__attribute__((target("sha,sse4.1,ssse3"))) static void
+sha256_blocks_shani(uint32_t state[8], const uint8_t* data, size_t blocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i       msg[4];
+    __m128i       abef;
+    __m128i       cdgh;
+    __m128i       tmp;
+
+    // The round instructions want the state split as ABEF / CDGH
+    tmp  = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &state[0]), 0xB1);
+    cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &state[4]), 0x1B);
+    abef = _mm_alignr_epi8(tmp, cdgh, 8);
+    cdgh = _mm_blend_epi16(cdgh, tmp, 0xF0);
+
+    while (blocks-- > 0)
+    {
+        const __m128i abef_save = abef;
+        const __m128i cdgh_save = cdgh;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (data + 16 * i)), mask);
+        }
+
+        for (int g = 0; g < 16; ++g)
+        {
+            tmp  = _mm_add_epi32(msg[g & 3], _mm_loadu_si128((const __m128i*) &sha256_k[4 * g]));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, tmp);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(tmp, 0x0E));
+
+            if (g < 12)
+            {
+                tmp = _mm_sha256msg1_epu32(msg[g & 3], msg[(g + 1) & 3]);
+                tmp = _mm_add_epi32(tmp, _mm_alignr_epi8(msg[(g + 3) & 3], msg[(g + 2) & 3], 4));
+                msg[g & 3] = _mm_sha256msg2_epu32(tmp, msg[(g + 3) & 3]);
+            }
+        }
+
+        abef = _mm_add_epi32(abef, abef_save);
+        cdgh = _mm_add_epi32(cdgh, cdgh_save);
+        data += 64;
+    }
+
+    tmp  = _mm_shuffle_epi32(abef, 0x1B);
+    cdgh = _mm_shuffle_epi32(cdgh, 0xB1);
+    _mm_storeu_si128((__m128i*) &state[0], _mm_blend_epi16(tmp, cdgh, 0xF0));
+    _mm_storeu_si128((__m128i*) &state[4], _mm_alignr_epi8(cdgh, tmp, 8));
+}
+
+static const sha256_accel_t sha256_accel_shani = {"x86-sha-ni", sha256_blocks_shani};
+
+const sha256_accel_t*
+sha256_accel_probe(void)
+{
+    unsigned int eax = 0;
+    unsigned int ebx = 0;
+    unsigned int ecx = 0;
+    unsigned int edx = 0;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (ecx & bit_SSSE3) == 0 ||
+        (ecx & bit_SSE4_1) == 0)
+    {
+        return NULL;
+    }
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || (ebx & bit_SHA) == 0)
+    {
+        return NULL;
+    }
+    return &sha256_accel_shani;
+}
+
+#elif defined(SHA256_ACCEL_ARMV8)
+#if defined(__clang__)
+#define SHA256_ARMV8_TARGET __attribute__((target("sha2")))
+#else
+#define SHA256_ARMV8_TARGET __attribute__((target("+crypto")))
+#endif
+
+SHA256_ARMV8_TARGET static void
+sha256_blocks_armv8(uint32_t state[8], const uint8_t* data, size_t blocks)
+{
+    uint32x4_t abcd = vld1q_u32(&state[0]);
+    uint32x4_t efgh = vld1q_u32(&state[4]);
+    uint32x4_t msg[4];
+
+    while (blocks-- > 0)
+    {
+        const uint32x4_t abcd_save = abcd;
+        const uint32x4_t efgh_save = efgh;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+        }
+
+        for (int g = 0; g < 16; ++g)
+        {
+            const uint32x4_t wk   = vaddq_u32(msg[g & 3], vld1q_u32(&sha256_k[4 * g]));
+            const uint32x4_t prev = abcd;
+
+            abcd = vsha256hq_u32(abcd, efgh, wk);
+            efgh = vsha256h2q_u32(efgh, prev, wk);
+
+            if (g < 12)
+            {
+                msg[g & 3] = vsha256su1q_u32(vsha256su0q_u32(msg[g & 3], msg[(g + 1) & 3]),
+                                             msg[(g + 2) & 3], msg[(g + 3) & 3]);
+            }
+        }
+
+        abcd = vaddq_u32(abcd, abcd_save);
+        efgh = vaddq_u32(efgh, efgh_save);
+        data += 64;
+    }
+
+    vst1q_u32(&state[0], abcd);
+    vst1q_u32(&state[4], efgh);
+}
+
+static const sha256_accel_t sha256_accel_armv8 = {"armv8-sha2", sha256_blocks_armv8};
+
+const sha256_accel_t*
+sha256_accel_probe(void)
+{
+#if defined(__APPLE__)
+    // Every Apple arm64 core implements the SHA2 extension
+    return &sha256_accel_armv8;
+#elif defined(__linux__) && defined(HWCAP_SHA2)
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0 ? &sha256_accel_armv8 : NULL;
+#else
+    return NULL;
+#endif
+}
+
+#else
+
+const sha256_accel_t*
+sha256_accel_probe(void)
+{
+    return NULL;
+}
+
+#endif
+
+static void
+store_be32(uint8_t* out, uint32_t value)
+{
+    out[0] = (uint8_t) (value >> 24);
+    out[1] = (uint8_t) (value >> 16);
+    out[2] = (uint8_t) (value >> 8);
+    out[3] = (uint8_t) value;
+}
+
+// Build the final padded block(s) from the last len % 64 bytes of a
+// message; returns how many 64-byte blocks tail holds
+static size_t
+sha256_tail(uint8_t tail[128], const uint8_t* data, size_t len, uint64_t total_len)
+{
+    size_t   rest     = len % 64;
+    size_t   tail_len = rest < 56 ? 64 : 128;
+    uint64_t bits     = total_len * 8;
+
+    memset(tail, 0, 128);
+    if (rest > 0)
+    {
+        memcpy(tail, data + len - rest, rest);
+    }
+    tail[rest] = 0x80;
+    store_be32(&tail[tail_len - 8], (uint32_t) (bits >> 32));
+    store_be32(&tail[tail_len - 4], (uint32_t) bits);
+
+    return tail_len / 64;
+}
+
+void
+sha256_accel_finish(const sha256_accel_t* accel, const uint32_t midstate[8], uint64_t prefix_len,
+                    const uint8_t* data, size_t len, uint8_t digest[32])
+{
+    uint32_t state[8];
+    uint8_t  tail[128];
+    size_t   full = len / 64;
+
+    memcpy(state, midstate, sizeof(state));
+    if (full > 0)
+    {
+        accel->blocks(state, data, full);
+    }
+    accel->blocks(state, tail, sha256_tail(tail, data, len, prefix_len + len));
+
+    for (int i = 0; i < 8; ++i)
+    {
+        store_be32(&digest[4 * i], state[i]);
+    }
+
+    secure_zero(state, sizeof(state));
+    secure_zero(tail, sizeof(tail));
+}
+
+#if defined(SHA256_ACCEL_X86) || defined(SHA256_ACCEL_ARMV8)
+static uint32_t
+load_be32(const uint8_t* in)
+{
+    return ((uint32_t) in[0] << 24) | ((uint32_t) in[1] << 16) | ((uint32_t) in[2] << 8) | in[3];
+}
+
+// The multi-buffer kernels are the FIPS 180-4 rounds written once over GCC
+// vector types; each vector element is one lane's copy of a state or
+// schedule word, so the same source serves every width.
+typedef uint32_t sha256_vec4_t __attribute__((vector_size(16)));
+typedef uint32_t sha256_vec8_t __attribute__((vector_size(32)));
+
+#define SHA256_VROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define SHA256_LANES_KERNEL(fn, vec_t, lanes)                                                      \
+    static void fn(uint32_t* state, const uint8_t* const* data, size_t blocks)                     \
+    {                                                                                              \
+        vec_t s[8];                                                                                \
+        vec_t v[8];                                                                                \
+        vec_t w[16];                                                                               \
+                                                                                                   \
+        memcpy(s, state, sizeof(s));                                                               \
+        for (size_t b = 0; b < blocks; ++b)                                                        \
+        {                                                                                          \
+            for (int i = 0; i < 16; ++i)                                                           \
+            {                                                                                      \
+                for (int l = 0; l < (lanes); ++l)                                                  \
+                {                                                                                  \
+                    w[i][l] = load_be32(data[l] + 64 * b + 4 * i);                                 \
+                }                                                                                  \
+            }                                                                                      \
+            memcpy(v, s, sizeof(v));                                                               \
+                                                                                                   \
+            for (int r = 0; r < 64; ++r)                                                           \
+            {                                                                                      \
+                if (r >= 16)                                                                       \
+                {                                                                                  \
+                    vec_t x = w[(r + 1) & 15];                                                     \
+                    vec_t y = w[(r + 14) & 15];                                                    \
+                    w[r & 15] += (SHA256_VROTR(x, 7) ^ SHA256_VROTR(x, 18) ^ (x >> 3)) +           \
+                                 w[(r + 9) & 15] +                                                 \
+                                 (SHA256_VROTR(y, 17) ^ SHA256_VROTR(y, 19) ^ (y >> 10));          \
+                }                                                                                  \
+                                                                                                   \
+                vec_t t1 = v[7] + (SHA256_VROTR(v[4], 6) ^ SHA256_VROTR(v[4], 11) ^                \
+                                   SHA256_VROTR(v[4], 25)) +                                       \
+                           ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha256_k[r] + w[r & 15];             \
+                vec_t t2 = (SHA256_VROTR(v[0], 2) ^ SHA256_VROTR(v[0], 13) ^                       \
+                            SHA256_VROTR(v[0], 22)) +                                              \
+                           ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));                        \
+                                                                                                   \
+                v[7] = v[6];                                                                       \
+                v[6] = v[5];                                                                       \
+                v[5] = v[4];                                                                       \
+                v[4] = v[3] + t1;                                                                  \
+                v[3] = v[2];                                                                       \
+                v[2] = v[1];                                                                       \
+                v[1] = v[0];                                                                       \
+                v[0] = t1 + t2;                                                                    \
+            }                                                                                      \
+                                                                                                   \
+            for (int i = 0; i < 8; ++i)                                                            \
+            {                                                                                      \
+                s[i] += v[i];                                                                      \
+            }                                                                                      \
+        }                                                                                          \
+        memcpy(state, s, sizeof(s));                                                               \
+    }
+
+#if defined(SHA256_ACCEL_X86)
+__attribute__((target("avx2"))) SHA256_LANES_KERNEL(sha256_lanes_avx2, sha256_vec8_t, 8)
+__attribute__((target("sse2"))) SHA256_LANES_KERNEL(sha256_lanes_sse, sha256_vec4_t, 4)
+
+static const sha256_multi_t sha256_multi_avx2 = {"avx2-x8", 8, sha256_lanes_avx2};
+static const sha256_multi_t sha256_multi_sse  = {"sse-x4", 4, sha256_lanes_sse};
+
+const sha256_multi_t*
+sha256_multi_probe(void)
+{
+    // Unlike a bare cpuid bit, these also check the OS saves the YMM state
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return &sha256_multi_avx2;
+    }
+    return __builtin_cpu_supports("sse2") ? &sha256_multi_sse : NULL;
+}
+#else
+SHA256_LANES_KERNEL(sha256_lanes_neon, sha256_vec4_t, 4)
+
+static const sha256_multi_t sha256_multi_neon = {"neon-x4", 4, sha256_lanes_neon};
+
+const sha256_multi_t*
+sha256_multi_probe(void)
+{
+    return &sha256_multi_neon; // Advanced SIMD is part of the AArch64 base
+}
+#endif
+
+#else
+
+const sha256_multi_t*
+sha256_multi_probe(void)
+{
+    return NULL;
+}
+
+#endif
+
+void
+sha256_multi_finish(const sha256_multi_t* multi, const uint32_t midstate[8], uint64_t prefix_len,
+                    const uint8_t* const* data, size_t len, uint8_t* const* digests)
+{
+    uint32_t       state[8 * SHA256_MAX_LANES];
+    uint8_t        tails[SHA256_MAX_LANES][128];
+    const uint8_t* tail_ptrs[SHA256_MAX_LANES];
+    size_t         lanes       = multi->lanes;
+    size_t         tail_blocks = 0;
+
+    for (size_t w = 0; w < 8; ++w)
+    {
+        for (size_t l = 0; l < lanes; ++l)
+        {
+            state[w * lanes + l] = midstate[w];
+        }
+    }
+    if (len / 64 > 0)
+    {
+        multi->blocks(state, data, len / 64);
+    }
+
+    for (size_t l = 0; l < lanes; ++l)
+    {
+        tail_blocks  = sha256_tail(tails[l], data[l], len, prefix_len + len);
+        tail_ptrs[l] = tails[l];
+    }
+    multi->blocks(state, tail_ptrs, tail_blocks);
+
+    for (size_t l = 0; l < lanes; ++l)
+    {
+        for (size_t w = 0; w < 8; ++w)
+        {
+            store_be32(&digests[l][4 * w], state[w * lanes + l]);
+        }
+    }
+
+    secure_zero(state, sizeof(state));
+    secure_zero(tails, sizeof(tails));
+}
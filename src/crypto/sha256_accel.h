@@ -0,0 +1,67 @@
+//  Copyright 2025 Ross Kinard
+
+#ifndef INCLUDE_SHA256_ACCEL_H_
+#define INCLUDE_SHA256_ACCEL_H_
+
+#include "global/config.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * SHA-256 compression over whole 64-byte blocks, updating state in place.
+ */
+typedef void (*sha256_blocks_fn)(uint32_t state[8], const uint8_t* data, size_t blocks);
+
+typedef struct
+{
+    const char*      name;
+    sha256_blocks_fn blocks;
+} sha256_accel_t;
+
+/**
+ * Multi-buffer SHA-256: lanes independent messages of equal length are
+ * compressed side by side. state holds word w of lane l at
+ * state[w * lanes + l]; data[l] points at that lane's blocks.
+ */
+typedef void (*sha256_lanes_fn)(uint32_t* state, const uint8_t* const* data, size_t blocks);
+
+#define SHA256_MAX_LANES 8
+
+typedef struct
+{
+    const char*     name;
+    size_t          lanes;
+    sha256_lanes_fn blocks;
+} sha256_multi_t;
+
+/**
+ * Return the instruction-set SHA-256 implementation this CPU supports, or
+ * NULL when there is none (or CONFIG_SHA256_ACCEL is off). The caller is
+ * expected to run known answers through it before trusting it.
+ */
+const sha256_accel_t*
+sha256_accel_probe(void);
+
+/**
+ * Finish a SHA-256 whose first prefix_len bytes (a multiple of 64) are
+ * already folded into midstate: absorb data, pad, and write the digest.
+ */
+void
+sha256_accel_finish(const sha256_accel_t* accel, const uint32_t midstate[8], uint64_t prefix_len,
+                    const uint8_t* data, size_t len, uint8_t digest[32]);
+
+/**
+ * Return the widest multi-buffer SHA-256 this CPU supports, or NULL.
+ */
+const sha256_multi_t*
+sha256_multi_probe(void);
+
+/**
+ * sha256_accel_finish() for multi->lanes messages of len bytes at once;
+ * digests[l] receives the digest of data[l].
+ */
+void
+sha256_multi_finish(const sha256_multi_t* multi, const uint32_t midstate[8], uint64_t prefix_len,
+                    const uint8_t* const* data, size_t len, uint8_t* const* digests);
+
+#endif //  INCLUDE_SHA256_ACCEL_H_
@@ -1,12 +1,8 @@
 #ifndef MBEDTLS_CONFIG_H
 #define MBEDTLS_CONFIG_H
 
-#define MBEDTLS_PKCS5_C
+/* Enable only what's needed for SHA-256; HMAC is built in crypto.c */
 #define MBEDTLS_SHA256_C
-
-/* Enable only what's needed for HMAC-SHA256 */
-#define MBEDTLS_SHA256_C
-#define MBEDTLS_MD_C
 #define MBEDTLS_PLATFORM_C
 #define MBEDTLS_PLATFORM_MEMORY
 
@@ -8,8 +8,8 @@ typedef struct
 {
     uint8_t  failed_attempts;   // Global failed login count
     uint32_t last_attempt_time; // Timestamp of last failed attempt
-    uint8_t  user_count;
-    uint8_t  reserved[2]; // Reserved for future use (pads to 16 bytes)
+    uint32_t user_count;
+    uint8_t  reserved[2]; // Reserved for future use
     uint8_t  hmac[LOCKSYS_HASH_SIZE];
 } system_state_t;
 
@@ -28,6 +28,7 @@ typedef enum
     STATUS_ERR_STORAGE,
     STATUS_ERR_NOT_FOUND,
     STATUS_ERR_THROTTLED,
+    STATUS_ERR_FULL,
 } status_t;
 
 //  Add other shared types/macros here as needed
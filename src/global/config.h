@@ -18,22 +18,36 @@
 #endif
 
 // ==== Cryptographic Backend Detection ====
+// Both software backends may be linked; crypto.c picks one at startup
 
-#if defined(CRYPTO_BACKEND_TINYCRYPT)
-#define USE_TINYCRYPT
-
-#elif defined(CRYPTO_BACKEND_MBEDTLS)
-#define USE_MBEDTLS
-
-#elif defined(PLATFORM_ARDUINO)
+#if !defined(CRYPTO_BACKEND_TINYCRYPT) && !defined(CRYPTO_BACKEND_MBEDTLS) &&                     \
+    defined(PLATFORM_ARDUINO)
 // Default for Arduino builds: TinyCrypt
 #define CRYPTO_BACKEND_TINYCRYPT
+#endif
+
+#if defined(CRYPTO_BACKEND_TINYCRYPT)
 #define USE_TINYCRYPT
+#endif
+#if defined(CRYPTO_BACKEND_MBEDTLS)
+#define USE_MBEDTLS
+#endif
+#if !defined(USE_TINYCRYPT) && !defined(USE_MBEDTLS)
+#error "No crypto backend defined. Define CRYPTO_BACKEND_TINYCRYPT and/or CRYPTO_BACKEND_MBEDTLS."
+#endif
 
-#else
-#error "No crypto backend defined. Define CRYPTO_BACKEND_TINYCRYPT or CRYPTO_BACKEND_MBEDTLS."
+// ==== SHA-256 Acceleration ====
+// Link the native backend, which uses the CPU's SHA-256 instructions
+// (x86 SHA-NI, ARMv8 SHA2) when present, and the multi-buffer lanes
+#if !defined(PLATFORM_ARDUINO)
+#define CONFIG_SHA256_ACCEL
 #endif
 
+// Batch MACs also use the multi-buffer lanes under a hardware backend. Off by
+// default: at -O2 on x86 the AVX2 lanes beat mbedTLS 3-5x, but against SHA-NI
+// the winner changes with message length and load
+// #define CONFIG_SHA256_LANES_WITH_HARDWARE
+
 // ==== Key Storage Option ====
 #define USE_FIRMWARE_KEY
 // #define USE_DPAPI_KEY        // Windows only
@@ -47,16 +61,38 @@
 
 // ==== Data Storage ====
 #define STORAGE_FILENAME "storage/storage.bin"
+// #define CONFIG_STORAGE_MMAP  // POSIX only: serve the user/state image from a shared mapping
 
 // ==== Users ====
 #define ROOT_ADMIN_USERNAME "rootadmin"
+// Slots in the user store; an image with fewer is grown on the next boot.
+// Boot reads every slot and MAC-checks each one in use to rebuild the
+// index, so boot time grows linearly with MAX_USERS, not with the users
+// provisioned; RAM grows with it through the index and slot bitmap.
+#ifndef MAX_USERS
 #define MAX_USERS 10
+#endif
+
+// Username hash index buckets; power of two, at least twice MAX_USERS
+#ifndef CONFIG_USER_INDEX_BUCKETS
+#define CONFIG_USER_INDEX_BUCKETS 32
+#endif
+// Records relocated per locksys_step by online compaction (0 = disabled)
+#define CONFIG_USER_COMPACT_MOVES_PER_STEP 0
+// Verified user records kept in RAM (0 = always re-read and re-check the MAC)
+#define CONFIG_USER_CACHE_ENTRIES 8
+// Interval at which cached records are compared against storage again
+#define CONFIG_USER_CACHE_REVERIFY_SECONDS 60
+// Records authenticated per batch MAC pass when the index is rebuilt
+#if defined(PLATFORM_ARDUINO)
+#define CONFIG_USER_VERIFY_BATCH 1
+#else
+#define CONFIG_USER_VERIFY_BATCH 8
+#endif
 
 // ==== Login Throttling ====
 #define CONFIG_THROTTLE_DELAY_PER_FAILURE 2
 #define CONFIG_THROTTLE_DELAY_MAX 30
-#define CONFIG_STORAGE_INDEX_SYSTEM_STATE MAX_USERS
-#define CONFIG_TOTAL_STORAGE_SLOTS (MAX_USERS + 1)
 
 // ==== PIN and Access Control ====
 #define MAX_USERNAME_LEN 32
@@ -72,11 +108,34 @@
 #define LOCKSYS_MAX_ATTEMPTS 5
 
 // ==== Logging ====
-#define LOG_HMAC_SIZE 32
+#define LOG_TAG_SIZE 16 // Truncated HMAC-SHA256 per frame
 #define LOG_MAX_PAYLOAD 123
-#define LOG_ENTRY_SIZE 163
-#define LOG_MAX_ENTRIES 50
-#define LOG_MAX_SIZE_BYTES 8150
 #define LOG_STORAGE_FILENAME "storage/log.bin"
+#define LOG_RETIRED_FILENAME "storage/log.bin.old" // A log file set aside by log_init
+// Ring of fixed-size pages; the oldest page is reused once all are written
+#define CONFIG_LOG_PAGE_SIZE 512
+#define CONFIG_LOG_PAGE_COUNT 16
+// Pages per sealed segment. Each full segment is copied out of the ring
+// with a MAC'd seal before it is overwritten; 0 keeps no history beyond
+// the ring. The ring must hold at least two whole segments.
+#if defined(PLATFORM_ARDUINO)
+#define CONFIG_LOG_SEGMENT_PAGES 0
+#else
+#define CONFIG_LOG_SEGMENT_PAGES 4
+#endif
+#define LOG_SEGMENT_DIR "storage/log/"
+#define LOG_SEGMENT_INDEX_FILENAME "storage/log/index.bin"
+
+// When buffered log records reach storage; durability of each mode is
+// described in logging.h
+#define LOG_FLUSH_IMMEDIATE 0
+#define LOG_FLUSH_TRANSACTION 1
+#define LOG_FLUSH_TICK 2
+#define CONFIG_LOG_FLUSH_MODE LOG_FLUSH_TRANSACTION
+// Bytes of encoded frames held in RAM before a forced flush
+#define CONFIG_LOG_BUFFER_BYTES 256
+// #define CONFIG_LOG_ASYNC  // POSIX only: a writer thread MACs and persists records
+// Events queued for the writer thread before log_write blocks; power of two
+#define CONFIG_LOG_QUEUE_DEPTH 32
 
 #endif // INCLUDE_CONFIG_H_
@@ -5,11 +5,507 @@
 #include "hal/hal_time.h"
 #include <string.h>
 
+#if (CONFIG_USER_INDEX_BUCKETS & (CONFIG_USER_INDEX_BUCKETS - 1)) != 0 ||                       \
+    CONFIG_USER_INDEX_BUCKETS < (2 * MAX_USERS)
+#error "CONFIG_USER_INDEX_BUCKETS must be a power of two and at least twice MAX_USERS"
+#endif
+
+#define USER_INDEX_MASK (CONFIG_USER_INDEX_BUCKETS - 1)
+
+// Open-addressed (linear probing) username -> slot index, rebuilt from storage at init
+typedef struct
+{
+    uint32_t     hash;
+    user_index_t slot;
+    uint8_t      occupied;
+} user_index_entry_t;
+
+static user_index_entry_t user_index[CONFIG_USER_INDEX_BUCKETS];
+static bool               user_index_ready = false;
+
+#define USER_SLOT_WORD_BITS 32
+#define USER_SLOT_WORDS ((MAX_USERS + USER_SLOT_WORD_BITS - 1) / USER_SLOT_WORD_BITS)
+
+// RAM mirror of the persistent slot allocation bitmap (1 = in use)
+static uint32_t     slot_bitmap[USER_SLOT_WORDS];
+static user_index_t slot_capacity  = 0;
+static user_index_t slot_free_hint = 0; // No free slot below this word
+
+// Verified-record cache. Entries hold records whose MAC was checked at the
+// storage generation in cache_generation; any storage write this module did
+// not make itself moves the generation on and flushes the cache.
+typedef struct
+{
+    user_record_t record;
+    user_index_t  slot;
+    uint32_t      last_used;
+    uint8_t       valid;
+} user_cache_entry_t;
+
+#if CONFIG_USER_CACHE_ENTRIES > 0
+static user_cache_entry_t user_cache[CONFIG_USER_CACHE_ENTRIES];
+#endif
+static uint32_t user_cache_generation = 0;
+static uint32_t user_cache_clock      = 0;
+static uint32_t user_cache_next_sweep = 0;
+
+static void
+user_cache_flush(void)
+{
+#if CONFIG_USER_CACHE_ENTRIES > 0
+    secure_zero(user_cache, sizeof(user_cache));
+#endif
+    hal_storage_get_generation(&user_cache_generation);
+}
+
+static user_cache_entry_t*
+user_cache_find(user_index_t slot)
+{
+#if CONFIG_USER_CACHE_ENTRIES > 0
+    uint32_t generation = 0;
+
+    hal_storage_get_generation(&generation);
+    if (generation != user_cache_generation)
+    {
+        user_cache_flush();
+        return NULL;
+    }
+
+    for (size_t i = 0; i < CONFIG_USER_CACHE_ENTRIES; ++i)
+    {
+        if (user_cache[i].valid && user_cache[i].slot == slot)
+        {
+            user_cache[i].last_used = ++user_cache_clock;
+            return &user_cache[i];
+        }
+    }
+#else
+    (void) slot;
+#endif
+
+    return NULL;
+}
+
+static void
+user_cache_store(user_index_t slot, const user_record_t* user)
+{
+#if CONFIG_USER_CACHE_ENTRIES > 0
+    user_cache_entry_t* victim = &user_cache[0];
+
+    for (size_t i = 0; i < CONFIG_USER_CACHE_ENTRIES; ++i)
+    {
+        if (user_cache[i].valid && user_cache[i].slot == slot)
+        {
+            victim = &user_cache[i];
+            break;
+        }
+        if (!user_cache[i].valid ||
+            (victim->valid && user_cache[i].last_used < victim->last_used))
+        {
+            victim = &user_cache[i];
+        }
+    }
+
+    victim->record    = *user;
+    victim->slot      = slot;
+    victim->last_used = ++user_cache_clock;
+    victim->valid     = 1;
+#else
+    (void) slot;
+    (void) user;
+#endif
+}
+
+// Called after this module wrote a slot: if that write is the only one since
+// the cache was last in step, keep the cache and refresh or drop the entry.
+static void
+user_cache_note_write(user_index_t slot, const user_record_t* user)
+{
+    uint32_t generation = 0;
+
+    hal_storage_get_generation(&generation);
+    if (generation != user_cache_generation + 1)
+    {
+        user_cache_flush();
+        return;
+    }
+
+    user_cache_generation = generation;
+
+#if CONFIG_USER_CACHE_ENTRIES > 0
+    user_cache_entry_t* entry = user_cache_find(slot);
+    if (user)
+    {
+        user_cache_store(slot, user);
+    }
+    else if (entry)
+    {
+        secure_zero(entry, sizeof(*entry));
+    }
+#else
+    (void) slot;
+    (void) user;
+#endif
+}
+
+// Reads a slot and checks its MAC, unless a verified copy is cached
+static status_t
+user_record_load(user_index_t slot, user_record_t* out)
+{
+    user_cache_entry_t* entry  = user_cache_find(slot);
+    status_t            status = STATUS_OK;
+
+    if (entry)
+    {
+        *out = entry->record;
+    }
+    else
+    {
+        status = hal_storage_user_get(slot, out);
+        if (status == STATUS_OK)
+        {
+            status = user_record_validate_hmac(out);
+        }
+        if (status == STATUS_OK)
+        {
+            user_cache_store(slot, out);
+        }
+    }
+
+    return status;
+}
+
+static uint32_t
+user_index_hash(const char* name)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    size_t   len  = strnlen(name, MAX_USERNAME_LEN);
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        hash ^= (uint8_t) name[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static void
+user_index_insert(uint32_t hash, user_index_t slot)
+{
+    uint32_t pos = hash & USER_INDEX_MASK;
+
+    while (user_index[pos].occupied)
+    {
+        pos = (pos + 1) & USER_INDEX_MASK;
+    }
+
+    user_index[pos].hash     = hash;
+    user_index[pos].slot     = slot;
+    user_index[pos].occupied = 1;
+}
+
+static void
+user_index_remove_slot(user_index_t slot)
+{
+    uint32_t pos = 0;
+
+    for (pos = 0; pos < CONFIG_USER_INDEX_BUCKETS; ++pos)
+    {
+        if (user_index[pos].occupied && user_index[pos].slot == slot)
+        {
+            break;
+        }
+    }
+
+    if (pos == CONFIG_USER_INDEX_BUCKETS)
+    {
+        return;
+    }
+
+    // Backward-shift deletion keeps probe chains intact without tombstones
+    uint32_t hole = pos;
+    uint32_t next = (hole + 1) & USER_INDEX_MASK;
+    while (user_index[next].occupied)
+    {
+        uint32_t home = user_index[next].hash & USER_INDEX_MASK;
+        if (((next - home) & USER_INDEX_MASK) >= ((next - hole) & USER_INDEX_MASK))
+        {
+            user_index[hole] = user_index[next];
+            hole             = next;
+        }
+        next = (next + 1) & USER_INDEX_MASK;
+    }
+    memset(&user_index[hole], 0, sizeof(user_index[hole]));
+}
+
+// Keep the index consistent with the record just written to a slot
+static void
+user_index_sync_slot(user_index_t slot, const user_record_t* user)
+{
+    uint32_t hash = user_index_hash(user->username);
+
+    for (uint32_t pos = 0; pos < CONFIG_USER_INDEX_BUCKETS; ++pos)
+    {
+        if (user_index[pos].occupied && user_index[pos].slot == slot)
+        {
+            if (user_index[pos].hash == hash)
+            {
+                return;
+            }
+            user_index_remove_slot(slot);
+            break;
+        }
+    }
+
+    user_index_insert(hash, slot);
+}
+
+static bool
+user_record_is_blank(const user_record_t* user)
+{
+    const uint8_t* p     = (const uint8_t*) user;
+    uint8_t        accum = 0;
+
+    for (size_t i = 0; i < sizeof(*user); ++i)
+    {
+        accum |= p[i];
+    }
+
+    return accum == 0;
+}
+
+static status_t
+user_slot_mark(user_index_t slot, bool in_use)
+{
+    user_index_t word = slot / USER_SLOT_WORD_BITS;
+    uint32_t     bit  = 1u << (slot % USER_SLOT_WORD_BITS);
+    uint32_t     next = in_use ? (slot_bitmap[word] | bit) : (slot_bitmap[word] & ~bit);
+    status_t     status = hal_storage_bitmap_set(word, next);
+
+    if (status == STATUS_OK)
+    {
+        slot_bitmap[word] = next;
+        if (!in_use && word < slot_free_hint)
+        {
+            slot_free_hint = word;
+        }
+    }
+
+    return status;
+}
+
+// Finds a free slot; the hint makes this O(1) amortized. A slot whose bitmap
+// bit is clear but which still holds an authentic record (interrupted add,
+// tampered bitmap) is re-marked in use rather than overwritten.
+static status_t
+user_slot_alloc(user_index_t* out_slot)
+{
+    for (user_index_t word = slot_free_hint; word < USER_SLOT_WORDS; ++word)
+    {
+        while (slot_bitmap[word] != UINT32_MAX)
+        {
+            user_index_t  slot =
+                word * USER_SLOT_WORD_BITS + (user_index_t) __builtin_ctz(~slot_bitmap[word]);
+            user_record_t existing = {0};
+
+            if (slot >= slot_capacity)
+            {
+                return STATUS_ERR_FULL;
+            }
+
+            if (hal_storage_user_get(slot, &existing) == STATUS_OK &&
+                user_record_validate_hmac(&existing) == STATUS_OK)
+            {
+                if (user_slot_mark(slot, true) != STATUS_OK)
+                {
+                    return STATUS_ERR_STORAGE;
+                }
+                if (user_index_ready)
+                {
+                    user_index_sync_slot(slot, &existing);
+                }
+                continue;
+            }
+
+            slot_free_hint = word;
+            *out_slot      = slot;
+            return STATUS_OK;
+        }
+    }
+
+    slot_free_hint = USER_SLOT_WORDS;
+    return STATUS_ERR_FULL;
+}
+
+// Returns the slot already indexed under this record's username, if any
+static bool
+user_index_find_duplicate(const user_record_t* user, user_index_t* out_slot)
+{
+    uint32_t hash = user_index_hash(user->username);
+    uint32_t pos  = hash & USER_INDEX_MASK;
+
+    while (user_index[pos].occupied)
+    {
+        user_record_t other = {0};
+        if (user_index[pos].hash == hash &&
+            hal_storage_user_get(user_index[pos].slot, &other) == STATUS_OK &&
+            strncmp(other.username, user->username, MAX_USERNAME_LEN) == 0)
+        {
+            *out_slot = user_index[pos].slot;
+            return true;
+        }
+        pos = (pos + 1) & USER_INDEX_MASK;
+    }
+
+    return false;
+}
+
+static status_t
+user_slot_release(user_index_t slot)
+{
+    user_record_t   blank          = {0};
+    user_counters_t blank_counters = {0};
+    status_t        status         = hal_storage_user_set(slot, &blank);
+
+    if (status == STATUS_OK)
+    {
+        user_cache_note_write(slot, NULL);
+        status = hal_storage_counters_set(slot, &blank_counters);
+    }
+    if (status == STATUS_OK)
+    {
+        status = user_slot_mark(slot, false);
+    }
+    if (status == STATUS_OK && user_index_ready)
+    {
+        user_index_remove_slot(slot);
+    }
+
+    return status;
+}
+
+// Authenticate a batch of non-blank records with one batch MAC pass, then
+// index them in slot order. The bitmap is not authenticated, so an authentic
+// record gets its bit back if it was clear.
+static status_t
+user_index_add_batch(const user_index_t* slots, const user_record_t* records, size_t count)
+{
+    status_t       status = STATUS_OK;
+    const uint8_t* inputs[CONFIG_USER_VERIFY_BATCH];
+    uint8_t*       outputs[CONFIG_USER_VERIFY_BATCH];
+    uint8_t        macs[CONFIG_USER_VERIFY_BATCH][LOCKSYS_HASH_SIZE];
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        inputs[i]  = (const uint8_t*) &records[i];
+        outputs[i] = macs[i];
+    }
+    // On failure the MACs come back zeroed and no record authenticates
+    compute_internal_hmac_many(inputs, offsetof(user_record_t, record_hmac), outputs, count);
+
+    for (size_t i = 0; status == STATUS_OK && i < count; ++i)
+    {
+        user_index_t dup = 0;
+
+        if (secure_compare(macs[i], records[i].record_hmac, LOCKSYS_HASH_SIZE) != STATUS_OK)
+        {
+            // Left allocated: an unauthentic record is evidence, not free space
+        }
+        else if (user_index_find_duplicate(&records[i], &dup))
+        {
+            // Compaction interrupted after the copy; the lower slot wins
+            status = user_slot_release(slots[i]);
+        }
+        else
+        {
+            user_index_t word = slots[i] / USER_SLOT_WORD_BITS;
+            uint32_t     bit  = 1u << (slots[i] % USER_SLOT_WORD_BITS);
+
+            if (!(slot_bitmap[word] & bit))
+            {
+                status = user_slot_mark(slots[i], true);
+            }
+            user_index_insert(user_index_hash(records[i].username), slots[i]);
+        }
+    }
+
+    secure_zero(macs, sizeof(macs));
+    return status;
+}
+
+status_t
+user_index_build(void)
+{
+    status_t      status = STATUS_OK;
+    user_index_t  batch_slots[CONFIG_USER_VERIFY_BATCH];
+    user_record_t batch[CONFIG_USER_VERIFY_BATCH];
+    size_t        batched = 0;
+
+    memset(user_index, 0, sizeof(user_index));
+    memset(slot_bitmap, 0, sizeof(slot_bitmap));
+    slot_free_hint = 0;
+    user_cache_flush();
+
+    status = hal_storage_get_capacity(&slot_capacity);
+    if (status == STATUS_OK && slot_capacity > MAX_USERS)
+    {
+        status = STATUS_ERR_STORAGE;
+    }
+
+    // Every slot is read: a clear bit only means free once the record is
+    // blank, since clearing one must not hide a user
+    for (user_index_t word = 0; status == STATUS_OK && word < USER_SLOT_WORDS; ++word)
+    {
+        uint32_t marked = 0;
+        status          = hal_storage_bitmap_get(word, &marked);
+        slot_bitmap[word] = marked;
+
+        for (uint32_t bit = 0; status == STATUS_OK && bit < USER_SLOT_WORD_BITS; ++bit)
+        {
+            user_index_t slot = word * USER_SLOT_WORD_BITS + bit;
+
+            if (slot >= slot_capacity || hal_storage_user_get(slot, &batch[batched]) != STATUS_OK)
+            {
+                continue;
+            }
+
+            if (user_record_is_blank(&batch[batched]))
+            {
+                if (marked & (1u << bit))
+                {
+                    // Removal interrupted between clearing the record and the bit
+                    status = user_slot_mark(slot, false);
+                }
+            }
+            else
+            {
+                batch_slots[batched++] = slot;
+                if (batched == CONFIG_USER_VERIFY_BATCH)
+                {
+                    status  = user_index_add_batch(batch_slots, batch, batched);
+                    batched = 0;
+                }
+            }
+        }
+    }
+
+    if (status == STATUS_OK && batched > 0)
+    {
+        status = user_index_add_batch(batch_slots, batch, batched);
+    }
+    secure_zero(batch, sizeof(batch));
+
+    user_index_ready = (status == STATUS_OK);
+
+    return status;
+}
+
 status_t
-user_find_by_username(const char* name, uint8_t* out_index, user_record_t* out_user)
+user_find_by_username(const char* name, user_index_t* out_index, user_record_t* out_user)
 {
     status_t status = STATUS_ERR_NOT_FOUND;
-    uint8_t  i;
 
     if (!name || !out_index || !out_user)
     {
@@ -17,24 +513,78 @@ user_find_by_username(const char* name, uint8_t* out_index, user_record_t* out_u
     }
     else
     {
-        for (i = 0; i < MAX_USERS; ++i)
+        if (!user_index_ready)
+        {
+            user_index_build();
+        }
+
+        uint32_t hash = user_index_hash(name);
+        uint32_t pos  = hash & USER_INDEX_MASK;
+
+        while (user_index[pos].occupied)
         {
             user_record_t temp = {0};
-            if (hal_storage_user_get(i, &temp) == STATUS_OK &&
-                user_record_validate_hmac(&temp) == STATUS_OK &&
+            if (user_index[pos].hash == hash &&
+                user_record_load(user_index[pos].slot, &temp) == STATUS_OK &&
                 strncmp(temp.username, name, MAX_USERNAME_LEN) == 0)
             {
-                *out_index = i;
+                *out_index = user_index[pos].slot;
                 *out_user  = temp;
                 status     = STATUS_OK;
                 break;
             }
+            pos = (pos + 1) & USER_INDEX_MASK;
         }
     }
 
     return status;
 }
 
+status_t
+user_cache_step(uint32_t now)
+{
+    status_t status = STATUS_OK;
+
+    if (now < user_cache_next_sweep)
+    {
+        return status;
+    }
+    user_cache_next_sweep = now + CONFIG_USER_CACHE_REVERIFY_SECONDS;
+
+#if CONFIG_USER_CACHE_ENTRIES > 0
+    uint32_t generation = 0;
+
+    hal_storage_get_generation(&generation);
+    if (generation != user_cache_generation)
+    {
+        user_cache_flush();
+        return status;
+    }
+
+    // Re-read every cached record and drop any that no longer match storage
+    for (size_t i = 0; i < CONFIG_USER_CACHE_ENTRIES; ++i)
+    {
+        user_record_t stored = {0};
+
+        if (!user_cache[i].valid)
+        {
+            continue;
+        }
+
+        if (hal_storage_user_get(user_cache[i].slot, &stored) != STATUS_OK ||
+            memcmp(&stored, &user_cache[i].record, sizeof(stored)) != 0 ||
+            user_record_validate_hmac(&stored) != STATUS_OK)
+        {
+            secure_zero(&user_cache[i], sizeof(user_cache[i]));
+            status = STATUS_ERR_TAMPER;
+        }
+        secure_zero(&stored, sizeof(stored));
+    }
+#endif
+
+    return status;
+}
+
 status_t
 user_record_compute_hmac(user_record_t* user)
 {
@@ -85,6 +635,180 @@ user_record_validate_hmac(const user_record_t* user)
     return status;
 }
 
+// MAC input: the owner's username field (all MAX_USERNAME_LEN bytes) followed
+// by the counter fields
+static status_t
+user_counters_mac(const user_record_t* owner, const user_counters_t* counters, uint8_t* out)
+{
+    hmac_sha256_ctx_t ctx;
+    uint8_t           full[LOCKSYS_HASH_SIZE];
+    status_t          status = compute_internal_hmac_init(&ctx);
+
+    if (status == STATUS_OK)
+    {
+        hmac_sha256_update(&ctx, (const uint8_t*) owner->username, sizeof(owner->username));
+        hmac_sha256_update(&ctx, (const uint8_t*) counters, offsetof(user_counters_t, hmac));
+        status = hmac_sha256_final(&ctx, full);
+    }
+    if (status == STATUS_OK)
+    {
+        memcpy(out, full, USER_COUNTERS_MAC_SIZE);
+    }
+    secure_zero(full, sizeof(full));
+
+    return status;
+}
+
+status_t
+user_counters_compute_hmac(const user_record_t* owner, user_counters_t* counters)
+{
+    status_t status = STATUS_ERR_INPUT;
+
+    if (owner && counters)
+    {
+        status = user_counters_mac(owner, counters, counters->hmac);
+    }
+
+    return status;
+}
+
+status_t
+user_counters_validate_hmac(const user_record_t* owner, const user_counters_t* counters)
+{
+    status_t status                           = STATUS_ERR_INPUT;
+    uint8_t  computed[USER_COUNTERS_MAC_SIZE] = {0};
+
+    if (owner && counters)
+    {
+        status = user_counters_mac(owner, counters, computed);
+    }
+    if (status == STATUS_OK &&
+        secure_compare(computed, counters->hmac, USER_COUNTERS_MAC_SIZE) != STATUS_OK)
+    {
+        status = STATUS_ERR_AUTH;
+    }
+
+    return status;
+}
+
+status_t
+user_counters_write(user_index_t index, const user_record_t* owner, user_counters_t* counters)
+{
+    status_t status = user_counters_compute_hmac(owner, counters);
+
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_counters_set(index, counters);
+    }
+
+    return status;
+}
+
+status_t
+user_record_write(user_index_t index, user_record_t* user)
+{
+    status_t status = STATUS_OK;
+
+    if (!user)
+    {
+        status = STATUS_ERR_INPUT;
+    }
+    else
+    {
+        status = user_record_compute_hmac(user);
+
+        if (status == STATUS_OK)
+        {
+            status = hal_storage_user_set(index, user);
+        }
+
+        if (status == STATUS_OK)
+        {
+            user_cache_note_write(index, user);
+        }
+        else
+        {
+            user_cache_flush();
+        }
+
+        if (status == STATUS_OK && user_index_ready)
+        {
+            user_index_sync_slot(index, user);
+        }
+    }
+
+    return status;
+}
+
+status_t
+user_txn_begin(const char* username, user_txn_t* txn)
+{
+    status_t status = STATUS_OK;
+
+    if (!username || !txn)
+    {
+        status = STATUS_ERR_INPUT;
+    }
+    else
+    {
+        memset(txn, 0, sizeof(*txn));
+        status = user_find_by_username(username, &txn->index, &txn->record);
+        if (status == STATUS_OK)
+        {
+            status = hal_storage_counters_get(txn->index, &txn->counters);
+        }
+        if (status == STATUS_OK)
+        {
+            status = user_counters_validate_hmac(&txn->record, &txn->counters);
+        }
+        if (status != STATUS_OK)
+        {
+            user_txn_abort(txn);
+        }
+    }
+
+    return status;
+}
+
+status_t
+user_txn_commit(user_txn_t* txn)
+{
+    status_t status = STATUS_OK;
+
+    if (!txn)
+    {
+        status = STATUS_ERR_INPUT;
+    }
+    else
+    {
+        if (txn->dirty)
+        {
+            status = user_record_write(txn->index, &txn->record);
+        }
+        if (status == STATUS_OK && txn->counters_dirty)
+        {
+            status = user_counters_write(txn->index, &txn->record, &txn->counters);
+        }
+        // One sync for both halves; a failed attempt must survive a power cut
+        if (status == STATUS_OK && (txn->dirty || txn->counters_dirty))
+        {
+            status = hal_storage_sync();
+        }
+        user_txn_abort(txn);
+    }
+
+    return status;
+}
+
+void
+user_txn_abort(user_txn_t* txn)
+{
+    if (txn)
+    {
+        secure_zero(txn, sizeof(*txn));
+    }
+}
+
 status_t
 user_add(const char* username, const char* password, uint8_t is_admin)
 {
@@ -96,6 +820,19 @@ user_add(const char* username, const char* password, uint8_t is_admin)
     if (validate_password_requirements(password) != STATUS_OK)
         return STATUS_ERR_INPUT;
 
+    user_record_t existing = {0};
+    user_index_t  existing_idx;
+    if (user_find_by_username(username, &existing_idx, &existing) == STATUS_OK)
+    {
+        secure_zero(&existing, sizeof(existing));
+        return STATUS_ERR_INPUT; // Usernames are unique
+    }
+
+    if (!user_index_ready && user_index_build() != STATUS_OK)
+    {
+        return STATUS_ERR_STORAGE;
+    }
+
     user_record_t new_user = {0};
     strncpy(new_user.username, username, MAX_USERNAME_LEN);
     new_user.user_flags = USER_FLAG_IS_ENABLED;
@@ -105,11 +842,11 @@ user_add(const char* username, const char* password, uint8_t is_admin)
         new_user.user_flags = new_user.user_flags | USER_FLAG_IS_ADMIN;
     }
 
-    uint32_t now                         = hal_get_timestamp();
-    new_user.created_timestamp           = now;
-    new_user.password_last_set           = now;
-    new_user.last_attempt_timestamp      = 0;
-    new_user.failed_attempts_since_login = 0;
+    uint32_t now               = hal_get_timestamp();
+    new_user.created_timestamp = now;
+    new_user.password_last_set = now;
+
+    user_counters_t counters = {0};
 
     // Compute password HMAC
     if (compute_internal_hmac((const uint8_t*) password,
@@ -119,27 +856,160 @@ user_add(const char* username, const char* password, uint8_t is_admin)
         return STATUS_ERR_INTERNAL;
     }
 
-    // Compute full record HMAC
-    if (user_record_compute_hmac(&new_user) != STATUS_OK)
+    user_index_t new_usr_idx = 0;
+    status_t     status      = user_slot_alloc(&new_usr_idx);
+    if (status != STATUS_OK)
+    {
+        return status;
+    }
+
+    // Counters, record, then the bitmap bit: an interrupted add leaves an
+    // authentic user in a free slot, which allocation re-marks in use
+    if (user_counters_write(new_usr_idx, &new_user, &counters) != STATUS_OK ||
+        user_record_write(new_usr_idx, &new_user) != STATUS_OK ||
+        user_slot_mark(new_usr_idx, true) != STATUS_OK || hal_storage_sync() != STATUS_OK)
     {
         return STATUS_ERR_INTERNAL;
     }
 
     system_state_t state = {0};
-    hal_storage_get_system_state(&state);
-    uint8_t new_usr_idx = state.user_count;
-    state.user_count++;
-    hal_storage_set_system_state(&state);
-
-    // Write to user slot
-    if (hal_storage_user_set(new_usr_idx, &new_user) != STATUS_OK)
+    if (hal_storage_get_system_state(&state) == STATUS_OK)
     {
-        return STATUS_ERR_INTERNAL;
+        state.user_count++;
+        hal_storage_set_system_state(&state);
     }
 
     return STATUS_OK;
 }
 
+status_t
+user_remove(const char* username)
+{
+    status_t      status = STATUS_OK;
+    user_record_t user   = {0};
+    user_index_t  index  = 0;
+
+    if (validate_safe_string(username, MAX_USERNAME_LEN) != STATUS_OK ||
+        strncmp(username, ROOT_ADMIN_USERNAME, MAX_USERNAME_LEN) == 0)
+    {
+        return STATUS_ERR_INPUT;
+    }
+
+    status = user_find_by_username(username, &index, &user);
+    secure_zero(&user, sizeof(user));
+
+    // Record cleared before the bit, so a crash never resurrects the user
+    if (status == STATUS_OK)
+    {
+        status = user_slot_release(index);
+    }
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_sync();
+    }
+
+    if (status == STATUS_OK)
+    {
+        system_state_t state = {0};
+        if (hal_storage_get_system_state(&state) == STATUS_OK && state.user_count > 0)
+        {
+            state.user_count--;
+            hal_storage_set_system_state(&state);
+        }
+    }
+
+    return status;
+}
+
+status_t
+user_compact_step(uint32_t max_moves, uint32_t* out_moved)
+{
+    status_t status = STATUS_OK;
+    uint32_t moved  = 0;
+
+    if (!user_index_ready)
+    {
+        status = user_index_build();
+    }
+
+    while (status == STATUS_OK && moved < max_moves)
+    {
+        user_index_t    free_slot = 0;
+        user_index_t    last_used = 0;
+        bool            found     = false;
+        user_record_t   user      = {0};
+        user_counters_t counters  = {0};
+
+        // Highest allocated slot
+        for (user_index_t word = USER_SLOT_WORDS; word-- > 0 && !found;)
+        {
+            if (slot_bitmap[word] != 0)
+            {
+                last_used = word * USER_SLOT_WORD_BITS + 31 -
+                            (user_index_t) __builtin_clz(slot_bitmap[word]);
+                found     = true;
+            }
+        }
+
+        if (!found || user_slot_alloc(&free_slot) != STATUS_OK || free_slot >= last_used)
+        {
+            break;
+        }
+
+        status = hal_storage_user_get(last_used, &user);
+        if (status == STATUS_OK)
+        {
+            status = hal_storage_counters_get(last_used, &counters);
+        }
+        if (status == STATUS_OK && (user_record_validate_hmac(&user) != STATUS_OK ||
+                                    user_counters_validate_hmac(&user, &counters) != STATUS_OK))
+        {
+            break; // Never relocate an unauthentic record
+        }
+
+        // Copy, then release the source; index build resolves an interrupted move.
+        // The counters are re-MAC'd for the record they now sit next to.
+        if (status == STATUS_OK)
+        {
+            status = user_counters_write(free_slot, &user, &counters);
+        }
+        if (status == STATUS_OK)
+        {
+            status = user_record_write(free_slot, &user);
+        }
+        if (status == STATUS_OK)
+        {
+            status = user_slot_mark(free_slot, true);
+        }
+        // The one sync per move: the copy is on disk before the source goes.
+        // A lost release leaves a duplicate that index build resolves.
+        if (status == STATUS_OK)
+        {
+            status = hal_storage_sync();
+        }
+        if (status == STATUS_OK)
+        {
+            status = user_slot_release(last_used);
+        }
+        if (status == STATUS_OK)
+        {
+            moved++;
+        }
+        secure_zero(&user, sizeof(user));
+    }
+
+    if (status == STATUS_OK && moved > 0)
+    {
+        status = hal_storage_sync(); // Settle the last release
+    }
+    if (out_moved)
+    {
+        *out_moved = moved;
+    }
+
+    return status;
+}
+
 status_t
 user_get_is_admin(const char* username, bool* out_is_admin)
 {
@@ -153,7 +1023,7 @@ user_get_is_admin(const char* username, bool* out_is_admin)
     else
     {
         user_record_t user;
-        uint8_t       index;
+        user_index_t  index;
         status = user_find_by_username(username, &index, &user);
 
         if (status == STATUS_OK)
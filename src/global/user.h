@@ -10,19 +10,20 @@
 // User flags
 #define USER_FLAG_IS_ENABLED 0x01
 #define USER_FLAG_IS_ADMIN 0x02
-#define USER_FLAG_IS_LOCKED 0x04
+#define USER_FLAG_IS_LOCKED 0x04 // Kept in user_counters_t.flags
 #define USER_FLAG_FORCE_PASS_RESET 0x08
 #define USER_FLAG_RESERVED1 0x10
 #define USER_FLAG_RESERVED2 0x20
 #define USER_FLAG_RESERVED3 0x40
 #define USER_FLAG_RESERVED4 0x80
 
+// Storage slot of a user record
+typedef uint32_t user_index_t;
+
 typedef struct __attribute__((packed))
 {
     char     username[MAX_USERNAME_LEN];
     uint8_t  password_hmac[LOCKSYS_HASH_SIZE];
-    uint8_t  failed_attempts_since_login;
-    uint32_t last_attempt_timestamp;
     uint32_t created_timestamp;
     uint32_t password_last_set;
     uint8_t  user_flags;
@@ -30,8 +31,44 @@ typedef struct __attribute__((packed))
     uint8_t  record_hmac[LOCKSYS_HASH_SIZE];
 } user_record_t;
 
+#define USER_COUNTERS_MAC_SIZE 16
+
+// Fields updated on every login attempt. Kept out of user_record_t so an
+// attempt rewrites only these bytes. The truncated MAC also covers the
+// owner's username, so another user's clean counters do not authenticate
+// next to a copied record; a record and its counters move between slots
+// together.
+typedef struct __attribute__((packed))
+{
+    uint8_t  failed_attempts_since_login;
+    uint32_t last_attempt_timestamp;
+    uint8_t  flags; // USER_FLAG_IS_LOCKED
+    uint8_t  reserved[2];
+    uint8_t  hmac[USER_COUNTERS_MAC_SIZE];
+} user_counters_t;
+
+// Read-modify-write transaction over a single user: the record and counters
+// are loaded and validated once, mutated in memory and on commit only the
+// parts flagged dirty are written back.
+typedef struct
+{
+    user_index_t    index;
+    user_record_t   record;
+    user_counters_t counters;
+    bool            dirty;
+    bool            counters_dirty;
+} user_txn_t;
+
+status_t
+user_find_by_username(const char* name, user_index_t* out_index, user_record_t* out_user);
+
+status_t
+user_index_build(void);
+
+// Re-reads cached records at most every CONFIG_USER_CACHE_REVERIFY_SECONDS and
+// evicts any that no longer match storage (STATUS_ERR_TAMPER if one was found).
 status_t
-user_find_by_username(const char* name, uint8_t* out_index, user_record_t* out_user);
+user_cache_step(uint32_t now);
 
 status_t
 user_record_compute_hmac(user_record_t* user);
@@ -39,9 +76,38 @@ user_record_compute_hmac(user_record_t* user);
 status_t
 user_record_validate_hmac(const user_record_t* user);
 
+status_t
+user_record_write(user_index_t index, user_record_t* user);
+
+status_t
+user_counters_compute_hmac(const user_record_t* owner, user_counters_t* counters);
+
+status_t
+user_counters_validate_hmac(const user_record_t* owner, const user_counters_t* counters);
+
+status_t
+user_counters_write(user_index_t index, const user_record_t* owner, user_counters_t* counters);
+
+status_t
+user_txn_begin(const char* username, user_txn_t* txn);
+
+status_t
+user_txn_commit(user_txn_t* txn);
+
+void
+user_txn_abort(user_txn_t* txn);
+
 status_t
 user_add(const char* username, const char* password, uint8_t is_admin);
 
+status_t
+user_remove(const char* username);
+
+// Moves up to max_moves records from the top of the slot table into free
+// slots below them, keeping allocated slots dense.
+status_t
+user_compact_step(uint32_t max_moves, uint32_t* out_moved);
+
 status_t
 user_get_is_admin(const char* username, bool* out_is_admin);
 
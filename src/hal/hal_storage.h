@@ -13,39 +13,120 @@
 status_t
 hal_load_device_key(uint8_t* key_buf, size_t key_len);
 
+// Storage image (hal_storage_layout.c). Opened, formatted or migrated on
+// first use; every other call initializes implicitly.
+
+status_t
+hal_storage_init(void);
+
+status_t
+hal_storage_get_capacity(user_index_t* out);
+
+// Counter bumped by every user record write, resize or migration; callers
+// holding copies of records compare it to detect writes they did not make.
+status_t
+hal_storage_get_generation(uint32_t* out);
+
 status_t
 hal_storage_get_system_state(system_state_t* out);
 
+// Durable on return: the throttle state must survive a power cut
 status_t
 hal_storage_set_system_state(system_state_t* in);
 
+// Record, counter and bitmap writes are not durable until hal_storage_sync(),
+// so an operation that writes several of them pays for one sync at the
+// point where its ordering or durability requires it.
+status_t
+hal_storage_sync(void);
+
 // User records
 
 status_t
-hal_storage_user_get(uint8_t index, user_record_t* out);
+hal_storage_user_get(user_index_t index, user_record_t* out);
+
+status_t
+hal_storage_user_set(user_index_t index, const user_record_t* in);
+
+// Per-user counters, stored next to each record but written separately
+
+status_t
+hal_storage_counters_get(user_index_t index, user_counters_t* out);
+
+status_t
+hal_storage_counters_set(user_index_t index, const user_counters_t* in);
+
+// Slot allocation bitmap, one bit per user slot (1 = in use)
+
+status_t
+hal_storage_bitmap_get(uint32_t word_index, uint32_t* out_word);
+
+status_t
+hal_storage_bitmap_set(uint32_t word_index, uint32_t word);
+
+// Raw image access, implemented by each platform backend. Writes become
+// durable with hal_storage_raw_sync(); resizes are durable on return and
+// zero-fill any new bytes.
+
+status_t
+hal_storage_raw_read(size_t offset, void* dst, size_t len);
+
+status_t
+hal_storage_raw_write(size_t offset, const void* src, size_t len);
 
 status_t
-hal_storage_user_set(uint8_t index, const user_record_t* in);
+hal_storage_raw_get_size(size_t* out_size);
 
-// Log records
+status_t
+hal_storage_raw_resize(size_t size);
 
-typedef struct log_stream_t log_stream_t;
+status_t
+hal_storage_raw_sync(void);
 
-struct log_record_t;
+// Log ring file, same contract as the raw image primitives: positional,
+// writes and resizes durable on return, resizing zero-fills new bytes.
+// Its page and frame layout belongs to the logging module.
+
+status_t
+hal_storage_log_read(size_t offset, uint8_t* dst, size_t len);
+
+status_t
+hal_storage_log_write(size_t offset, const uint8_t* src, size_t len);
 
 status_t
 hal_storage_log_get_size(size_t* out_size);
 
-bool
-hal_log_stream_open(log_stream_t* stream);
+status_t
+hal_storage_log_resize(size_t size);
+
+// Move the log file aside to LOG_RETIRED_FILENAME; the next log access
+// starts a new, empty file. Fails without touching either file if a log
+// retired earlier is still there.
+status_t
+hal_storage_log_retire(void);
+
+// Sealed log segments (CONFIG_LOG_SEGMENT_PAGES > 0, hosted backends only):
+// one file per segment number under LOG_SEGMENT_DIR, written once when
+// sealed and afterwards only read or removed, plus an index of seals.
+// Writes are durable on return. Reads of a missing segment file return
+// STATUS_ERR_NOT_FOUND; a missing index has size 0.
 
-bool
-hal_log_stream_next(log_stream_t* stream, struct log_record_t* rec);
+status_t
+hal_storage_segment_write(uint32_t segment, size_t offset, const uint8_t* src, size_t len);
+
+status_t
+hal_storage_segment_read(uint32_t segment, size_t offset, uint8_t* dst, size_t len);
 
-void
-hal_log_stream_close(log_stream_t* stream);
+status_t
+hal_storage_segment_remove(uint32_t segment);
+
+status_t
+hal_storage_segment_index_write(size_t offset, const uint8_t* src, size_t len);
+
+status_t
+hal_storage_segment_index_read(size_t offset, uint8_t* dst, size_t len);
 
 status_t
-hal_storage_log_append(const uint8_t* src, size_t len);
+hal_storage_segment_index_get_size(size_t* out_size);
 
 #endif //  INCLUDE_HAL_STORAGE_H_
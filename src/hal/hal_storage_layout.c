@@ -0,0 +1,877 @@
+//  Copyright 2025 Ross Kinard
+
+// Platform-independent layout of the user/state storage image. Platform
+// backends only provide raw byte access and a sync (hal_storage_raw_*); this
+// file decides where a sync is needed for ordering or durability.
+//
+// Format version 4:
+//
+//   0                            storage_header_t (STORAGE_HEADER_SIZE bytes, MAC'd)
+//   STORAGE_STATE_OFFSET         system_state_t (STORAGE_STATE_SIZE bytes)
+//   STORAGE_SLOTS_OFFSET         slot[capacity]: user_record_t followed by user_counters_t
+//   header.bitmap_offset         uint32_t[STORAGE_BITMAP_WORDS(capacity)] slot allocation bitmap
+//
+// The counter part of a slot holds the per-login fields and is written on its
+// own, so a failed attempt does not rewrite (or re-MAC) the credential record.
+// Its MAC covers the username of the record beside it.
+//
+// The bitmap trails the slot table so the capacity can grow without moving
+// slots: a larger table is followed by a relocated bitmap and the header
+// is switched over last.
+//
+// Older formats are migrated on first open. The legacy image is first moved
+// behind the new one so an interrupted migration can be restarted from it;
+// the file size tells which copy to restart from. A file without a valid
+// header whose size fits no legacy or parked image is refused as tampered.
+//   Version 3: same layout; the counters MAC covered the slot index instead
+//   of the username. Re-MAC'd in place, since a restart can tell which
+//   binding each slot already has.
+//   Version 2: same header; 112-byte records with the counters inline.
+//   Version 1 (implicit, no header): MAX_USERS (then 10) such records
+//   followed by the system state slot.
+
+#include "hal/hal_storage.h"
+
+#include "crypto/crypto.h"
+#include "global/config.h"
+#include <stddef.h>
+#include <string.h>
+
+#define STORAGE_MAGIC 0x59534B4Cu // "LKSY"
+#define STORAGE_FORMAT_VERSION 4
+#define STORAGE_HEADER_SIZE 64
+#define STORAGE_STATE_SIZE 64
+#define STORAGE_STATE_OFFSET ((size_t) STORAGE_HEADER_SIZE)
+#define STORAGE_SLOTS_OFFSET (STORAGE_STATE_OFFSET + STORAGE_STATE_SIZE)
+#define STORAGE_SLOT_SIZE (sizeof(user_record_t) + sizeof(user_counters_t))
+#define STORAGE_SLOT_OFFSET(i) (STORAGE_SLOTS_OFFSET + (size_t) (i) * STORAGE_SLOT_SIZE)
+#define STORAGE_WORD_BITS 32
+#define STORAGE_BITMAP_WORDS(cap) (((size_t) (cap) + STORAGE_WORD_BITS - 1) / STORAGE_WORD_BITS)
+#define STORAGE_BITMAP_OFFSET(cap) STORAGE_SLOT_OFFSET(cap)
+#define STORAGE_IMAGE_SIZE(cap)                                                                    \
+    (STORAGE_BITMAP_OFFSET(cap) + STORAGE_BITMAP_WORDS(cap) * sizeof(uint32_t))
+
+#define STORAGE_V2_RECORDS_OFFSET (STORAGE_STATE_OFFSET + sizeof(user_record_v2_t))
+#define STORAGE_V2_IMAGE_SIZE(cap)                                                                 \
+    (STORAGE_V2_RECORDS_OFFSET + (size_t) (cap) * sizeof(user_record_v2_t) +                      \
+     STORAGE_BITMAP_WORDS(cap) * sizeof(uint32_t))
+
+#define STORAGE_V1_USERS 10
+#define STORAGE_V1_STATE_OFFSET ((size_t) STORAGE_V1_USERS * sizeof(user_record_v2_t))
+#define STORAGE_V1_SIZE ((size_t) (STORAGE_V1_USERS + 1) * sizeof(user_record_v2_t))
+
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size; // Bytes per slot
+    uint32_t capacity;
+    uint32_t bitmap_offset;
+    uint8_t  reserved[16];
+    uint8_t  hmac[LOCKSYS_HASH_SIZE];
+} storage_header_t;
+
+_Static_assert(sizeof(storage_header_t) == STORAGE_HEADER_SIZE, "storage header size");
+_Static_assert(sizeof(system_state_t) <= STORAGE_STATE_SIZE, "system state must fit its slot");
+
+// User record as written by format versions 1 and 2
+typedef struct __attribute__((packed))
+{
+    char     username[MAX_USERNAME_LEN];
+    uint8_t  password_hmac[LOCKSYS_HASH_SIZE];
+    uint8_t  failed_attempts_since_login;
+    uint32_t last_attempt_timestamp;
+    uint32_t created_timestamp;
+    uint32_t password_last_set;
+    uint8_t  user_flags;
+    uint8_t  reserved[2];
+    uint8_t  record_hmac[LOCKSYS_HASH_SIZE];
+} user_record_v2_t;
+
+// System state as written by format version 1
+typedef struct
+{
+    uint8_t  failed_attempts;
+    uint32_t last_attempt_time;
+    uint8_t  user_count;
+    uint8_t  reserved[2];
+    uint8_t  hmac[LOCKSYS_HASH_SIZE];
+} system_state_v1_t;
+
+_Static_assert(STORAGE_IMAGE_SIZE(MAX_USERS) > STORAGE_V1_SIZE,
+               "a current image must not be mistaken for a version 1 image by its size");
+
+static storage_header_t header;
+static bool             storage_ready      = false;
+static uint32_t         storage_generation = 0;
+
+static status_t
+header_compute_hmac(storage_header_t* hdr)
+{
+    memset(hdr->hmac, 0, sizeof(hdr->hmac));
+    return compute_internal_hmac((const uint8_t*) hdr, offsetof(storage_header_t, hmac), hdr->hmac,
+                                 sizeof(hdr->hmac));
+}
+
+// Checks the magic and MAC only; the caller dispatches on the version
+static status_t
+header_validate(const storage_header_t* hdr)
+{
+    uint8_t computed[LOCKSYS_HASH_SIZE];
+
+    if (hdr->magic != STORAGE_MAGIC)
+    {
+        return STATUS_ERR_UNINITIALIZED;
+    }
+
+    if (compute_internal_hmac((const uint8_t*) hdr, offsetof(storage_header_t, hmac), computed,
+                              sizeof(computed)) != STATUS_OK ||
+        secure_compare(computed, hdr->hmac, sizeof(computed)) != STATUS_OK)
+    {
+        return STATUS_ERR_TAMPER;
+    }
+
+    return STATUS_OK;
+}
+
+static status_t
+header_write(uint32_t capacity)
+{
+    storage_header_t hdr = {0};
+
+    hdr.magic         = STORAGE_MAGIC;
+    hdr.version       = STORAGE_FORMAT_VERSION;
+    hdr.record_size   = STORAGE_SLOT_SIZE;
+    hdr.capacity      = capacity;
+    hdr.bitmap_offset = (uint32_t) STORAGE_BITMAP_OFFSET(capacity);
+
+    status_t status = header_compute_hmac(&hdr);
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_raw_write(0, &hdr, sizeof(hdr));
+    }
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_raw_sync();
+    }
+    if (status == STATUS_OK)
+    {
+        header = hdr;
+    }
+
+    return status;
+}
+
+// Relocate the bitmap behind a larger slot table, then switch the header
+static status_t
+storage_grow(uint32_t new_capacity)
+{
+    size_t   old_offset = header.bitmap_offset;
+    size_t   old_words  = STORAGE_BITMAP_WORDS(header.capacity);
+    size_t   new_offset = STORAGE_BITMAP_OFFSET(new_capacity);
+    status_t status     = hal_storage_raw_resize(STORAGE_IMAGE_SIZE(new_capacity));
+
+    for (size_t i = 0; i < old_words && status == STATUS_OK; ++i)
+    {
+        uint32_t word = 0;
+        status        = hal_storage_raw_read(old_offset + i * sizeof(word), &word, sizeof(word));
+        if (status == STATUS_OK)
+        {
+            status = hal_storage_raw_write(new_offset + i * sizeof(word), &word, sizeof(word));
+        }
+    }
+
+    // The copy is on disk before the header points at it
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_raw_sync();
+    }
+    if (status == STATUS_OK)
+    {
+        status = header_write(new_capacity);
+    }
+    storage_generation++;
+
+    // The old bitmap now lies inside free slots; clear it
+    for (size_t i = 0; i < old_words && status == STATUS_OK; ++i)
+    {
+        uint32_t zero = 0;
+        status        = hal_storage_raw_write(old_offset + i * sizeof(zero), &zero, sizeof(zero));
+    }
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_raw_sync();
+    }
+
+    return status;
+}
+
+// Copy len bytes within the image; the ranges may overlap
+static status_t
+storage_move(size_t dst, size_t src, size_t len)
+{
+    uint8_t  chunk[128];
+    status_t status = STATUS_OK;
+
+    for (size_t done = 0; done < len && status == STATUS_OK;)
+    {
+        size_t n = (len - done < sizeof(chunk)) ? len - done : sizeof(chunk);
+        // Moving up, copy from the end so no source byte is overwritten unread
+        size_t pos = (dst > src) ? len - done - n : done;
+
+        status = hal_storage_raw_read(src + pos, chunk, n);
+        if (status == STATUS_OK)
+        {
+            status = hal_storage_raw_write(dst + pos, chunk, n);
+        }
+        done += n;
+    }
+
+    secure_zero(chunk, sizeof(chunk));
+
+    return status;
+}
+
+static bool
+legacy_record_authentic(const user_record_v2_t* old)
+{
+    uint8_t computed[LOCKSYS_HASH_SIZE];
+
+    return compute_internal_hmac((const uint8_t*) old, offsetof(user_record_v2_t, record_hmac),
+                                 computed, sizeof(computed)) == STATUS_OK &&
+           secure_compare(computed, old->record_hmac, sizeof(computed)) == STATUS_OK;
+}
+
+static bool
+legacy_state_authentic(const system_state_v1_t* old)
+{
+    uint8_t computed[LOCKSYS_HASH_SIZE];
+
+    return compute_internal_hmac((const uint8_t*) old, offsetof(system_state_v1_t, hmac), computed,
+                                 sizeof(computed)) == STATUS_OK &&
+           secure_compare(computed, old->hmac, sizeof(computed)) == STATUS_OK;
+}
+
+// Split an authentic legacy record into a record and its counters
+static bool
+storage_convert_record(const user_record_v2_t* old, user_record_t* rec, user_counters_t* counters)
+{
+    if (!legacy_record_authentic(old))
+    {
+        return false;
+    }
+
+    memcpy(rec->username, old->username, sizeof(rec->username));
+    memcpy(rec->password_hmac, old->password_hmac, sizeof(rec->password_hmac));
+    rec->created_timestamp = old->created_timestamp;
+    rec->password_last_set = old->password_last_set;
+    rec->user_flags        = old->user_flags & (uint8_t) ~USER_FLAG_IS_LOCKED;
+
+    counters->failed_attempts_since_login = old->failed_attempts_since_login;
+    counters->last_attempt_timestamp      = old->last_attempt_timestamp;
+    counters->flags                       = old->user_flags & USER_FLAG_IS_LOCKED;
+
+    return user_record_compute_hmac(rec) == STATUS_OK &&
+           user_counters_compute_hmac(rec, counters) == STATUS_OK;
+}
+
+// Version 3 counters MAC: the slot index (little endian) followed by the
+// counter fields
+static bool
+legacy_counters_authentic(user_index_t slot, const user_counters_t* counters)
+{
+    hmac_sha256_ctx_t ctx;
+    uint8_t           index[sizeof(uint32_t)];
+    uint8_t           full[LOCKSYS_HASH_SIZE];
+    status_t          status = compute_internal_hmac_init(&ctx);
+
+    index[0] = (uint8_t) slot;
+    index[1] = (uint8_t) (slot >> 8);
+    index[2] = (uint8_t) (slot >> 16);
+    index[3] = (uint8_t) (slot >> 24);
+
+    if (status == STATUS_OK)
+    {
+        hmac_sha256_update(&ctx, index, sizeof(index));
+        hmac_sha256_update(&ctx, (const uint8_t*) counters, offsetof(user_counters_t, hmac));
+        status = hmac_sha256_final(&ctx, full);
+    }
+    if (status == STATUS_OK)
+    {
+        status = secure_compare(full, counters->hmac, sizeof(counters->hmac));
+    }
+    secure_zero(full, sizeof(full));
+
+    return status == STATUS_OK;
+}
+
+// Re-MAC version 3 counters for the record beside them. Counters that already
+// carry the new binding are left alone, so an interrupted pass can be rerun;
+// counters authentic under neither stay as they are and fail on use.
+static status_t
+storage_rebind_counters(uint32_t capacity)
+{
+    status_t status = STATUS_OK;
+
+    for (user_index_t i = 0; i < capacity && status == STATUS_OK; ++i)
+    {
+        user_record_t   rec      = {0};
+        user_counters_t counters = {0};
+
+        status = hal_storage_raw_read(STORAGE_SLOT_OFFSET(i), &rec, sizeof(rec));
+        if (status == STATUS_OK)
+        {
+            status = hal_storage_raw_read(STORAGE_SLOT_OFFSET(i) + sizeof(rec), &counters,
+                                          sizeof(counters));
+        }
+        if (status == STATUS_OK && user_counters_validate_hmac(&rec, &counters) != STATUS_OK &&
+            legacy_counters_authentic(i, &counters))
+        {
+            status = user_counters_compute_hmac(&rec, &counters);
+            if (status == STATUS_OK)
+            {
+                status = hal_storage_raw_write(STORAGE_SLOT_OFFSET(i) + sizeof(rec), &counters,
+                                               sizeof(counters));
+            }
+        }
+        secure_zero(&rec, sizeof(rec));
+    }
+
+    // Every slot is rebound before the header marks the image current
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_raw_sync();
+    }
+    if (status == STATUS_OK)
+    {
+        status = header_write(capacity);
+    }
+    storage_generation++;
+
+    return status;
+}
+
+// Rewrite a version 1 or 2 image of legacy_len bytes at legacy_offset in the
+// current format. Only authentic records and state are carried over.
+static status_t
+storage_migrate(uint16_t from_version, uint32_t legacy_cap, size_t legacy_offset, size_t legacy_len)
+{
+    size_t         image_size = STORAGE_IMAGE_SIZE(MAX_USERS);
+    size_t         parked     = image_size;
+    size_t         records    = (from_version == 1) ? 0 : STORAGE_V2_RECORDS_OFFSET;
+    uint32_t       bitmap[STORAGE_BITMAP_WORDS(MAX_USERS)];
+    system_state_t state  = {0};
+    status_t       status = STATUS_OK;
+
+    memset(bitmap, 0, sizeof(bitmap));
+
+    // A short version 1 image reads as zeros past its end. Park it at full
+    // size so an interrupted migration is recognized by the file size alone.
+    if (from_version == 1 && legacy_len > 0 && legacy_len < STORAGE_V1_SIZE)
+    {
+        legacy_len = STORAGE_V1_SIZE;
+    }
+
+    if (legacy_len == 0)
+    {
+        legacy_cap = 0; // Blank device: nothing to carry over
+        status     = hal_storage_raw_resize(image_size);
+    }
+    else if (legacy_offset != parked)
+    {
+        size_t top = ((legacy_offset > parked) ? legacy_offset : parked) + legacy_len;
+
+        // One byte past the parked copy marks the move as in progress: the
+        // size then matches no parked image and a restart uses the original
+        status = hal_storage_raw_resize(top + 1);
+        if (status == STATUS_OK)
+        {
+            status = storage_move(parked, legacy_offset, legacy_len);
+        }
+        // The whole parked copy is on disk before the size says it is
+        if (status == STATUS_OK)
+        {
+            status = hal_storage_raw_sync();
+        }
+    }
+    if (status == STATUS_OK && legacy_len > 0)
+    {
+        status = hal_storage_raw_resize(parked + legacy_len);
+    }
+
+    user_index_t slots = (legacy_cap > MAX_USERS) ? legacy_cap : MAX_USERS;
+    for (user_index_t i = 0; i < slots && status == STATUS_OK; ++i)
+    {
+        user_record_v2_t old      = {0};
+        user_record_t    rec      = {0};
+        user_counters_t  counters = {0};
+
+        if (i < legacy_cap)
+        {
+            status = hal_storage_raw_read(parked + records + (size_t) i * sizeof(old), &old,
+                                          sizeof(old));
+        }
+
+        if (status == STATUS_OK && i < legacy_cap &&
+            storage_convert_record(&old, &rec, &counters))
+        {
+            if (i >= MAX_USERS)
+            {
+                status = STATUS_ERR_STORAGE; // Would drop a provisioned user
+                break;
+            }
+            bitmap[i / STORAGE_WORD_BITS] |= 1u << (i % STORAGE_WORD_BITS);
+        }
+        else
+        {
+            memset(&rec, 0, sizeof(rec));
+            memset(&counters, 0, sizeof(counters));
+        }
+
+        if (status == STATUS_OK && i < MAX_USERS)
+        {
+            status = hal_storage_raw_write(STORAGE_SLOT_OFFSET(i), &rec, sizeof(rec));
+        }
+        if (status == STATUS_OK && i < MAX_USERS)
+        {
+            status = hal_storage_raw_write(STORAGE_SLOT_OFFSET(i) + sizeof(rec), &counters,
+                                           sizeof(counters));
+        }
+
+        secure_zero(&old, sizeof(old));
+        secure_zero(&rec, sizeof(rec));
+    }
+
+    // Carry the throttle state over only if it was authentic
+    if (status == STATUS_OK && legacy_len > 0 && from_version == 1)
+    {
+        system_state_v1_t old_state;
+
+        status = hal_storage_raw_read(parked + STORAGE_V1_STATE_OFFSET, &old_state,
+                                      sizeof(old_state));
+        if (status == STATUS_OK && legacy_state_authentic(&old_state))
+        {
+            state.failed_attempts   = old_state.failed_attempts;
+            state.last_attempt_time = old_state.last_attempt_time;
+            state.user_count        = old_state.user_count;
+            status                  = system_state_compute_hmac(&state);
+        }
+    }
+    else if (status == STATUS_OK && legacy_len > 0)
+    {
+        status = hal_storage_raw_read(parked + STORAGE_STATE_OFFSET, &state, sizeof(state));
+        if (status == STATUS_OK && system_state_validate_hmac(&state) != STATUS_OK)
+        {
+            memset(&state, 0, sizeof(state));
+        }
+    }
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_raw_write(STORAGE_STATE_OFFSET, &state, sizeof(state));
+    }
+
+    for (size_t i = 0; i < STORAGE_BITMAP_WORDS(MAX_USERS) && status == STATUS_OK; ++i)
+    {
+        status = hal_storage_raw_write(STORAGE_BITMAP_OFFSET(MAX_USERS) + i * sizeof(bitmap[i]),
+                                       &bitmap[i], sizeof(bitmap[i]));
+    }
+
+    // Every converted slot is on disk before the header marks the image current
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_raw_sync();
+    }
+
+    if (status == STATUS_OK)
+    {
+        status = header_write(MAX_USERS);
+    }
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_raw_resize(image_size);
+    }
+    storage_generation++;
+
+    return status;
+}
+
+// An image without a header is taken as version 1 only if it is blank or
+// holds at least one authentic record or state. A damaged header on a newer
+// image must not be migrated as if it were one, which would drop every user.
+static status_t
+storage_v1_check(size_t size)
+{
+    bool     blank  = true;
+    bool     found  = false;
+    status_t status = STATUS_OK;
+
+    for (size_t i = 0; i <= STORAGE_V1_USERS && status == STATUS_OK && !found; ++i)
+    {
+        size_t           offset = i * sizeof(user_record_v2_t);
+        user_record_v2_t slot   = {0};
+        size_t           len    = 0;
+
+        if (offset < size)
+        {
+            len    = (size - offset < sizeof(slot)) ? size - offset : sizeof(slot);
+            status = hal_storage_raw_read(offset, &slot, len);
+        }
+
+        for (size_t b = 0; b < len && blank; ++b)
+        {
+            blank = ((const uint8_t*) &slot)[b] == 0;
+        }
+
+        if (status == STATUS_OK && len > 0)
+        {
+            if (i < STORAGE_V1_USERS)
+            {
+                found = legacy_record_authentic(&slot);
+            }
+            else
+            {
+                system_state_v1_t state;
+
+                memcpy(&state, &slot, sizeof(state));
+                found = legacy_state_authentic(&state);
+                secure_zero(&state, sizeof(state));
+            }
+        }
+        secure_zero(&slot, sizeof(slot));
+    }
+
+    if (status == STATUS_OK && !blank && !found)
+    {
+        status = STATUS_ERR_TAMPER;
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_init(void)
+{
+    status_t         status = STATUS_OK;
+    size_t           size   = 0;
+    storage_header_t hdr    = {0};
+
+    if (storage_ready)
+    {
+        return STATUS_OK;
+    }
+
+    status = hal_storage_raw_get_size(&size);
+
+    if (status == STATUS_OK && size >= sizeof(hdr))
+    {
+        status = hal_storage_raw_read(0, &hdr, sizeof(hdr));
+    }
+
+    if (status == STATUS_OK)
+    {
+        status_t hdr_status = header_validate(&hdr);
+
+        if (hdr_status == STATUS_OK && (hdr.version == STORAGE_FORMAT_VERSION || hdr.version == 3))
+        {
+            header = hdr;
+            if (hdr.record_size != STORAGE_SLOT_SIZE ||
+                hdr.bitmap_offset != STORAGE_BITMAP_OFFSET(hdr.capacity))
+            {
+                status = STATUS_ERR_STORAGE;
+            }
+            else if (hdr.version == 3)
+            {
+                status = storage_rebind_counters(hdr.capacity);
+            }
+
+            if (status == STATUS_OK && header.capacity < MAX_USERS)
+            {
+                status = storage_grow(MAX_USERS);
+            }
+            else if (status == STATUS_OK && header.capacity > MAX_USERS)
+            {
+                status = STATUS_ERR_STORAGE; // Shrinking is not supported
+            }
+            else if (status == STATUS_OK && size > STORAGE_IMAGE_SIZE(MAX_USERS))
+            {
+                status = hal_storage_raw_resize(STORAGE_IMAGE_SIZE(MAX_USERS));
+            }
+        }
+        else if (hdr_status == STATUS_OK && hdr.version == 2)
+        {
+            size_t legacy_len = STORAGE_V2_IMAGE_SIZE(hdr.capacity);
+
+            if (hdr.record_size != sizeof(user_record_v2_t) || hdr.capacity > MAX_USERS ||
+                size < legacy_len)
+            {
+                status = STATUS_ERR_STORAGE;
+            }
+            else if (size == STORAGE_IMAGE_SIZE(MAX_USERS) + legacy_len)
+            {
+                // Interrupted migration: restart from the parked image
+                status = storage_migrate(2, hdr.capacity, STORAGE_IMAGE_SIZE(MAX_USERS),
+                                         legacy_len);
+            }
+            else
+            {
+                status = storage_migrate(2, hdr.capacity, 0, legacy_len);
+            }
+        }
+        else if (hdr_status == STATUS_OK)
+        {
+            status = STATUS_ERR_STORAGE;
+        }
+        else if (hdr_status != STATUS_ERR_UNINITIALIZED)
+        {
+            status = hdr_status;
+        }
+        else if (size == STORAGE_IMAGE_SIZE(MAX_USERS) + STORAGE_V1_SIZE)
+        {
+            // Interrupted migration: restart from the parked version 1 image
+            status = storage_migrate(1, STORAGE_V1_USERS, STORAGE_IMAGE_SIZE(MAX_USERS),
+                                     STORAGE_V1_SIZE);
+        }
+        else if (size == STORAGE_IMAGE_SIZE(MAX_USERS) + STORAGE_V1_SIZE + 1)
+        {
+            // Interrupted while parking: the original is still intact
+            status = storage_migrate(1, STORAGE_V1_USERS, 0, STORAGE_V1_SIZE);
+        }
+        else if (size > STORAGE_V1_SIZE)
+        {
+            status = STATUS_ERR_TAMPER; // No known image has this size and no header
+        }
+        else
+        {
+            status = storage_v1_check(size);
+            if (status == STATUS_OK)
+            {
+                status = storage_migrate(1, STORAGE_V1_USERS, 0, size);
+            }
+        }
+    }
+
+    storage_ready = (status == STATUS_OK);
+
+    return status;
+}
+
+
+status_t
+hal_storage_get_capacity(user_index_t* out)
+{
+    status_t status = STATUS_ERR_INPUT;
+
+    if (out)
+    {
+        status = hal_storage_init();
+        if (status == STATUS_OK)
+        {
+            *out = header.capacity;
+        }
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_get_generation(uint32_t* out)
+{
+    status_t status = STATUS_ERR_INPUT;
+
+    if (out)
+    {
+        *out   = storage_generation;
+        status = STATUS_OK;
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_get_system_state(system_state_t* out)
+{
+    status_t status = STATUS_ERR_INPUT;
+
+    if (out)
+    {
+        status = hal_storage_init();
+        if (status == STATUS_OK)
+        {
+            status = hal_storage_raw_read(STORAGE_STATE_OFFSET, out, sizeof(*out));
+        }
+        if (status == STATUS_OK)
+        {
+            status = system_state_validate_hmac(out);
+        }
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_set_system_state(system_state_t* in)
+{
+    status_t status = STATUS_ERR_INPUT;
+
+    if (in)
+    {
+        status = hal_storage_init();
+        if (status == STATUS_OK)
+        {
+            status = system_state_compute_hmac(in);
+        }
+        if (status == STATUS_OK)
+        {
+            status = hal_storage_raw_write(STORAGE_STATE_OFFSET, in, sizeof(*in));
+        }
+        if (status == STATUS_OK)
+        {
+            status = hal_storage_raw_sync();
+        }
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_sync(void)
+{
+    status_t status = hal_storage_init();
+
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_raw_sync();
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_user_get(user_index_t index, user_record_t* out)
+{
+    status_t status = STATUS_ERR_INPUT;
+
+    if (out)
+    {
+        status = hal_storage_init();
+        if (status == STATUS_OK && index >= header.capacity)
+        {
+            status = STATUS_ERR_INPUT;
+        }
+        if (status == STATUS_OK)
+        {
+            status = hal_storage_raw_read(STORAGE_SLOT_OFFSET(index), out, sizeof(*out));
+        }
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_user_set(user_index_t index, const user_record_t* in)
+{
+    status_t status = STATUS_ERR_INPUT;
+
+    if (in)
+    {
+        status = hal_storage_init();
+        if (status == STATUS_OK && index >= header.capacity)
+        {
+            status = STATUS_ERR_INPUT;
+        }
+        if (status == STATUS_OK)
+        {
+            storage_generation++;
+            status = hal_storage_raw_write(STORAGE_SLOT_OFFSET(index), in, sizeof(*in));
+        }
+    }
+
+    return status;
+}
+
+// Counter writes leave the generation alone: they never touch a record
+
+status_t
+hal_storage_counters_get(user_index_t index, user_counters_t* out)
+{
+    status_t status = STATUS_ERR_INPUT;
+
+    if (out)
+    {
+        status = hal_storage_init();
+        if (status == STATUS_OK && index >= header.capacity)
+        {
+            status = STATUS_ERR_INPUT;
+        }
+        if (status == STATUS_OK)
+        {
+            status = hal_storage_raw_read(STORAGE_SLOT_OFFSET(index) + sizeof(user_record_t), out,
+                                          sizeof(*out));
+        }
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_counters_set(user_index_t index, const user_counters_t* in)
+{
+    status_t status = STATUS_ERR_INPUT;
+
+    if (in)
+    {
+        status = hal_storage_init();
+        if (status == STATUS_OK && index >= header.capacity)
+        {
+            status = STATUS_ERR_INPUT;
+        }
+        if (status == STATUS_OK)
+        {
+            status = hal_storage_raw_write(STORAGE_SLOT_OFFSET(index) + sizeof(user_record_t), in,
+                                           sizeof(*in));
+        }
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_bitmap_get(uint32_t word_index, uint32_t* out_word)
+{
+    status_t status = STATUS_ERR_INPUT;
+
+    if (out_word)
+    {
+        status = hal_storage_init();
+        if (status == STATUS_OK && word_index >= STORAGE_BITMAP_WORDS(header.capacity))
+        {
+            status = STATUS_ERR_INPUT;
+        }
+        if (status == STATUS_OK)
+        {
+            status = hal_storage_raw_read(header.bitmap_offset + (size_t) word_index *
+                                                                     sizeof(*out_word),
+                                          out_word, sizeof(*out_word));
+        }
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_bitmap_set(uint32_t word_index, uint32_t word)
+{
+    status_t status = hal_storage_init();
+
+    if (status == STATUS_OK && word_index >= STORAGE_BITMAP_WORDS(header.capacity))
+    {
+        status = STATUS_ERR_INPUT;
+    }
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_raw_write(header.bitmap_offset + (size_t) word_index * sizeof(word),
+                                       &word, sizeof(word));
+    }
+
+    return status;
+}
@@ -2,7 +2,7 @@
 
 #if defined(PLATFORM_POSIX)
 
-#include "hal_io.h"
+#include "hal/hal_io.h"
 
 #warning "Unsupported platform for hal_io.c, using dummy functions."
 
@@ -4,128 +4,610 @@
 
 #include "hal/hal_storage.h"
 
-#warning "Unsupported platform for hal_storage.c, using dummy functions."
-
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #ifdef USE_FIRMWARE_KEY
 #include "global/device_key.generated.h"
 #endif
 
+#if defined(__APPLE__)
+#define hal_fdatasync fsync // No fdatasync on Darwin
+#else
+#define hal_fdatasync fdatasync
+#endif
+
+// Descriptors are opened on first use and kept for the life of the process.
+// Image writes are made durable by hal_storage_raw_sync (fdatasync, or msync
+// for the mapped image), which the layout calls once per operation; log and
+// segment writes and every resize sync on their own. Reads never sync.
+static int storage_fd = -1;
+static int log_fd     = -1;
+#if defined(CONFIG_STORAGE_MMAP)
+static uint8_t* storage_map      = NULL;
+static size_t   storage_map_size = 0;
+#endif
+
+static void
+build_full_path_from_exe_dir(const char* relative_path, char* out_path, size_t out_len)
+{
+    char    exe_path[PATH_MAX];
+    ssize_t len = -1;
+
+#if defined(__linux__)
+    len = readlink("/proc/self/exe", exe_path, sizeof(exe_path) - 1);
+#endif
+
+    if (len <= 0)
+    {
+        strncpy(out_path, relative_path, out_len);
+        out_path[out_len - 1] = '\0';
+        return;
+    }
+    exe_path[len] = '\0';
+
+    char* last_slash = strrchr(exe_path, '/');
+    if (last_slash)
+    {
+        *(last_slash + 1) = '\0';
+    }
+
+    snprintf(out_path, out_len, "%s%s", exe_path, relative_path);
+}
+
+static void
+ensure_parent_dir_exists(const char* abs_path)
+{
+    char dir[PATH_MAX];
+
+    strncpy(dir, abs_path, sizeof(dir));
+    dir[sizeof(dir) - 1] = '\0';
+
+    char* last_slash = strrchr(dir, '/');
+    if (last_slash && last_slash != dir)
+    {
+        *last_slash = '\0';
+        mkdir(dir, 0700); // Ignore errors (already exists)
+    }
+}
+
+static int
+open_storage_file(const char* relative_path, int flags)
+{
+    char abs_path[PATH_MAX];
+    int  fd;
+
+    build_full_path_from_exe_dir(relative_path, abs_path, sizeof(abs_path));
+    ensure_parent_dir_exists(abs_path);
+
+    do
+    {
+        fd = open(abs_path, flags | O_CLOEXEC, 0600);
+    } while (fd < 0 && errno == EINTR);
+
+    return fd;
+}
+
+static status_t
+log_open(void)
+{
+    if (log_fd >= 0)
+    {
+        return STATUS_OK;
+    }
+
+    log_fd = open_storage_file(LOG_STORAGE_FILENAME, O_RDWR | O_CREAT);
+
+    return (log_fd >= 0) ? STATUS_OK : STATUS_ERR_STORAGE;
+}
+
+static status_t
+read_fully(int fd, void* dst, size_t len, off_t offset)
+{
+    uint8_t* p = (uint8_t*) dst;
+
+    while (len > 0)
+    {
+        ssize_t n = pread(fd, p, len, offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return STATUS_ERR_STORAGE;
+        }
+        p += n;
+        len -= (size_t) n;
+        offset += n;
+    }
+
+    return STATUS_OK;
+}
+
+static status_t
+write_fully(int fd, const void* src, size_t len, off_t offset)
+{
+    const uint8_t* p = (const uint8_t*) src;
+
+    while (len > 0)
+    {
+        ssize_t n = pwrite(fd, p, len, offset);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return STATUS_ERR_STORAGE;
+        }
+        p += n;
+        len -= (size_t) n;
+        offset += n;
+    }
+
+    return STATUS_OK;
+}
+
 status_t
 hal_load_device_key(uint8_t* key_buf, size_t key_len)
 {
-    if (key_buf && key_len > 0)
+    if (!key_buf || key_len != sizeof(DEVICE_KEY))
     {
-        key_buf[0] = 0xAB; // example dummy data
+        return STATUS_ERR_INTERNAL;
     }
+    memcpy(key_buf, DEVICE_KEY, key_len);
     return STATUS_OK;
 }
 
-status_t
-hal_storage_log_append(const uint8_t* src, size_t len)
+static status_t
+storage_open(void)
+{
+    if (storage_fd >= 0)
+    {
+        return STATUS_OK;
+    }
+
+    storage_fd = open_storage_file(STORAGE_FILENAME, O_RDWR | O_CREAT);
+
+    return (storage_fd >= 0) ? STATUS_OK : STATUS_ERR_STORAGE;
+}
+
+#if defined(CONFIG_STORAGE_MMAP)
+
+// The whole image is mapped shared: reads are a bounds-checked memcpy and
+// writes are a memcpy followed by an msync of the pages they touched.
+static status_t
+storage_map_image(void)
 {
-    (void) src;
-    (void) len;
+    struct stat st;
+
+    if (storage_map)
+    {
+        munmap(storage_map, storage_map_size);
+        storage_map      = NULL;
+        storage_map_size = 0;
+    }
+
+    if (fstat(storage_fd, &st) != 0 || st.st_size < 0)
+    {
+        return STATUS_ERR_STORAGE;
+    }
+
+    if (st.st_size > 0)
+    {
+        void* map =
+            mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, storage_fd, 0);
+        if (map == MAP_FAILED)
+        {
+            return STATUS_ERR_STORAGE;
+        }
+        storage_map      = (uint8_t*) map;
+        storage_map_size = (size_t) st.st_size;
+    }
+
     return STATUS_OK;
 }
 
-bool
-hal_log_stream_open(log_stream_t* stream)
+static status_t
+storage_ready(void)
 {
-    (void) stream;
-    return true;
+    status_t status = STATUS_OK;
+
+    if (storage_fd < 0)
+    {
+        status = storage_open();
+        if (status == STATUS_OK)
+        {
+            status = storage_map_image();
+        }
+    }
+
+    return status;
 }
 
-bool
-hal_log_stream_next(log_stream_t* stream, struct log_record_t* rec)
+status_t
+hal_storage_raw_read(size_t offset, void* dst, size_t len)
 {
-    (void) stream;
-    (void) rec;
-    return false; // no records
+    status_t status = storage_ready();
+
+    if (status == STATUS_OK &&
+        (!dst || offset > storage_map_size || len > storage_map_size - offset))
+    {
+        status = STATUS_ERR_INPUT;
+    }
+    if (status == STATUS_OK)
+    {
+        memcpy(dst, storage_map + offset, len);
+    }
+
+    return status;
 }
 
-void
-hal_log_stream_close(log_stream_t* stream)
+status_t
+hal_storage_raw_write(size_t offset, const void* src, size_t len)
 {
-    (void) stream;
+    status_t status = storage_ready();
+
+    if (status == STATUS_OK &&
+        (!src || offset > storage_map_size || len > storage_map_size - offset))
+    {
+        status = STATUS_ERR_INPUT;
+    }
+    if (status == STATUS_OK)
+    {
+        memcpy(storage_map + offset, src, len);
+    }
+
+    return status;
 }
 
 status_t
-hal_storage_user_get(uint8_t index, user_record_t* out)
+hal_storage_raw_get_size(size_t* out_size)
 {
-    if (!out || index >= MAX_USERS)
-        return STATUS_ERR_INPUT;
-    memset(out, 0, sizeof(user_record_t)); // dummy data for testing
-    return STATUS_OK;
+    status_t status = storage_ready();
+
+    if (status == STATUS_OK)
+    {
+        *out_size = storage_map_size;
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_raw_resize(size_t size)
+{
+    status_t status = storage_ready();
+
+    if (status == STATUS_OK &&
+        (ftruncate(storage_fd, (off_t) size) != 0 || hal_fdatasync(storage_fd) != 0))
+    {
+        status = STATUS_ERR_STORAGE;
+    }
+    if (status == STATUS_OK)
+    {
+        status = storage_map_image();
+    }
+
+    return status;
 }
 
 status_t
-hal_storage_user_set(uint8_t index, const user_record_t* in)
+hal_storage_raw_sync(void)
 {
-    if (!in || index >= MAX_USERS)
+    status_t status = storage_ready();
+
+    if (status == STATUS_OK && storage_map_size > 0 &&
+        msync(storage_map, storage_map_size, MS_SYNC) != 0)
+    {
+        status = STATUS_ERR_STORAGE;
+    }
+
+    return status;
+}
+
+#else // CONFIG_STORAGE_MMAP
+
+status_t
+hal_storage_raw_read(size_t offset, void* dst, size_t len)
+{
+    status_t status = storage_open();
+
+    if (status == STATUS_OK)
+    {
+        status = read_fully(storage_fd, dst, len, (off_t) offset);
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_raw_write(size_t offset, const void* src, size_t len)
+{
+    status_t status = storage_open();
+
+    if (status == STATUS_OK)
+    {
+        status = write_fully(storage_fd, src, len, (off_t) offset);
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_raw_get_size(size_t* out_size)
+{
+    struct stat st;
+    status_t    status = storage_open();
+
+    if (status == STATUS_OK && (fstat(storage_fd, &st) != 0 || st.st_size < 0))
+    {
+        status = STATUS_ERR_STORAGE;
+    }
+    if (status == STATUS_OK)
+    {
+        *out_size = (size_t) st.st_size;
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_raw_resize(size_t size)
+{
+    status_t status = storage_open();
+
+    if (status == STATUS_OK &&
+        (ftruncate(storage_fd, (off_t) size) != 0 || hal_fdatasync(storage_fd) != 0))
+    {
+        status = STATUS_ERR_STORAGE;
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_raw_sync(void)
+{
+    status_t status = storage_open();
+
+    if (status == STATUS_OK && hal_fdatasync(storage_fd) != 0)
+    {
+        status = STATUS_ERR_STORAGE;
+    }
+
+    return status;
+}
+
+#endif // CONFIG_STORAGE_MMAP
+
+// The log ring is a fixed-size file written in place, never through the map
+
+status_t
+hal_storage_log_read(size_t offset, uint8_t* dst, size_t len)
+{
+    status_t status = (dst || len == 0) ? log_open() : STATUS_ERR_INPUT;
+
+    if (status == STATUS_OK)
+    {
+        status = read_fully(log_fd, dst, len, (off_t) offset);
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_log_write(size_t offset, const uint8_t* src, size_t len)
+{
+    status_t status = (src || len == 0) ? log_open() : STATUS_ERR_INPUT;
+
+    if (status == STATUS_OK)
+    {
+        status = write_fully(log_fd, src, len, (off_t) offset);
+    }
+    if (status == STATUS_OK && hal_fdatasync(log_fd) != 0)
+    {
+        status = STATUS_ERR_STORAGE;
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_log_get_size(size_t* out_size)
+{
+    struct stat st;
+
+    if (!out_size)
+    {
         return STATUS_ERR_INPUT;
-    // could write to EEPROM later
+    }
+
+    if (log_open() != STATUS_OK || fstat(log_fd, &st) != 0 || st.st_size < 0)
+    {
+        return STATUS_ERR_STORAGE;
+    }
+
+    *out_size = (size_t) st.st_size;
     return STATUS_OK;
 }
 
 status_t
-hal_storage_get_system_state(system_state_t* out)
+hal_storage_log_resize(size_t size)
 {
-    if (!out)
-        return STATUS_ERR_INPUT;
-    memset(out, 0, sizeof(system_state_t)); // dummy
+    status_t status = log_open();
+
+    if (status == STATUS_OK &&
+        (ftruncate(log_fd, (off_t) size) != 0 || hal_fdatasync(log_fd) != 0))
+    {
+        status = STATUS_ERR_STORAGE;
+    }
+
+    return status;
+}
+
+status_t
+hal_storage_log_retire(void)
+{
+    char abs_path[PATH_MAX];
+    char retired_path[PATH_MAX];
+
+    build_full_path_from_exe_dir(LOG_STORAGE_FILENAME, abs_path, sizeof(abs_path));
+    build_full_path_from_exe_dir(LOG_RETIRED_FILENAME, retired_path, sizeof(retired_path));
+
+    // link() refuses to replace an existing file, unlike rename()
+    if (link(abs_path, retired_path) != 0 || unlink(abs_path) != 0)
+    {
+        return STATUS_ERR_STORAGE;
+    }
+
+    if (log_fd >= 0)
+    {
+        close(log_fd);
+        log_fd = -1;
+    }
+
     return STATUS_OK;
 }
 
+#if CONFIG_LOG_SEGMENT_PAGES > 0
+
+// Sealed segments are opened per call: they are written once when sealed
+// and read again only by verification or export
+
+static void
+segment_path(uint32_t segment, char* out, size_t out_len)
+{
+    snprintf(out, out_len, LOG_SEGMENT_DIR "%08" PRIx32 ".seg", segment);
+}
+
+static status_t
+segment_access(const char* relative_path, int flags, size_t offset, void* buf, size_t len,
+               bool writing)
+{
+    status_t status = STATUS_OK;
+    int      fd     = open_storage_file(relative_path, flags);
+
+    if (fd < 0)
+    {
+        return (errno == ENOENT) ? STATUS_ERR_NOT_FOUND : STATUS_ERR_STORAGE;
+    }
+
+    if (writing)
+    {
+        status = write_fully(fd, buf, len, (off_t) offset);
+        if (status == STATUS_OK && hal_fdatasync(fd) != 0)
+        {
+            status = STATUS_ERR_STORAGE;
+        }
+    }
+    else
+    {
+        status = read_fully(fd, buf, len, (off_t) offset);
+    }
+
+    close(fd);
+    return status;
+}
+
 status_t
-hal_storage_set_system_state(system_state_t* in)
+hal_storage_segment_write(uint32_t segment, size_t offset, const uint8_t* src, size_t len)
 {
-    if (!in)
+    char path[PATH_MAX];
+
+    if (!src && len > 0)
+    {
         return STATUS_ERR_INPUT;
-    return STATUS_OK;
+    }
+
+    segment_path(segment, path, sizeof(path));
+    return segment_access(path, O_RDWR | O_CREAT, offset, (void*) src, len, true);
 }
 
 status_t
-hal_storage_log_get_size(size_t* out_size)
+hal_storage_segment_read(uint32_t segment, size_t offset, uint8_t* dst, size_t len)
 {
-    if (!out_size)
+    char path[PATH_MAX];
+
+    if (!dst && len > 0)
+    {
         return STATUS_ERR_INPUT;
-    *out_size = 0;
+    }
+
+    segment_path(segment, path, sizeof(path));
+    return segment_access(path, O_RDONLY, offset, dst, len, false);
+}
+
+status_t
+hal_storage_segment_remove(uint32_t segment)
+{
+    char path[PATH_MAX];
+    char abs_path[PATH_MAX];
+
+    segment_path(segment, path, sizeof(path));
+    build_full_path_from_exe_dir(path, abs_path, sizeof(abs_path));
+
+    if (unlink(abs_path) != 0)
+    {
+        return (errno == ENOENT) ? STATUS_ERR_NOT_FOUND : STATUS_ERR_STORAGE;
+    }
+
     return STATUS_OK;
 }
 
 status_t
-hal_storage_log_get_size(size_t* out_size)
+hal_storage_segment_index_write(size_t offset, const uint8_t* src, size_t len)
 {
-    if (!out_size)
+    if (!src && len > 0)
     {
         return STATUS_ERR_INPUT;
     }
 
-    FILE* file = fopen(LOG_STORAGE_FILENAME, "rb");
-    if (!file)
+    return segment_access(LOG_SEGMENT_INDEX_FILENAME, O_RDWR | O_CREAT, offset, (void*) src, len,
+                          true);
+}
+
+status_t
+hal_storage_segment_index_read(size_t offset, uint8_t* dst, size_t len)
+{
+    if (!dst && len > 0)
     {
-        return STATUS_ERR_STORAGE;
+        return STATUS_ERR_INPUT;
     }
 
-    if (fseek(file, 0, SEEK_END) != 0)
+    return segment_access(LOG_SEGMENT_INDEX_FILENAME, O_RDONLY, offset, dst, len, false);
+}
+
+status_t
+hal_storage_segment_index_get_size(size_t* out_size)
+{
+    char        abs_path[PATH_MAX];
+    struct stat st;
+
+    if (!out_size)
     {
-        fclose(file);
-        return STATUS_ERR_STORAGE;
+        return STATUS_ERR_INPUT;
     }
 
-    long size = ftell(file);
-    fclose(file);
-
-    if (size < 0)
+    build_full_path_from_exe_dir(LOG_SEGMENT_INDEX_FILENAME, abs_path, sizeof(abs_path));
+    if (stat(abs_path, &st) != 0)
     {
-        return STATUS_ERR_STORAGE;
+        *out_size = 0; // Nothing sealed yet
+        return (errno == ENOENT) ? STATUS_OK : STATUS_ERR_STORAGE;
     }
 
-    *out_size = (size_t) size;
+    *out_size = (size_t) st.st_size;
     return STATUS_OK;
 }
 
+#endif // CONFIG_LOG_SEGMENT_PAGES
+
 #endif
@@ -5,6 +5,7 @@
 #if defined(PLATFORM_WINDOWS)
 
 #include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,8 +13,7 @@
 #include <windows.h>
 
 #include <direct.h>
-
-#include "logging/logging.h"
+#include <io.h>
 
 #ifdef USE_FIRMWARE_KEY
 #include "global/device_key.generated.h"
@@ -23,11 +23,6 @@
 #include <wincrypt.h>
 #endif
 
-struct log_stream_t
-{
-    FILE* file;
-};
-
 #define RELATIVE_STORAGE_DIR "build/storage/"
 #define MAX_STORAGE_SIZE 64
 
@@ -171,319 +166,346 @@ hal_load_device_key(uint8_t* key_buf, size_t key_len)
 #endif
 }
 
-status_t
-hal_storage_get_system_state(system_state_t* out)
+static status_t
+file_read(const char* relative_path, size_t offset, void* dst, size_t len)
 {
-    status_t status = STATUS_ERR_INPUT;
+    char abs_path[MAX_PATH];
+    build_full_path_from_exe_dir(relative_path, abs_path, sizeof(abs_path));
+
+    status_t status = STATUS_ERR_STORAGE;
     FILE*    file   = NULL;
 
-    if (out)
+    if (!dst)
+        return STATUS_ERR_INPUT;
+
+    file = fopen(abs_path, "rb");
+    if (!file)
+        return STATUS_ERR_STORAGE;
+
+    if (fseek(file, (long) offset, SEEK_SET) == 0)
     {
-        char abs_path[MAX_PATH];
-        build_full_path_from_exe_dir(STORAGE_FILENAME, abs_path, sizeof(abs_path));
-        file = fopen(abs_path, "rb");
-        if (file)
+        if (fread(dst, len, 1, file) == 1)
         {
-            if (fseek(file, CONFIG_STORAGE_INDEX_SYSTEM_STATE * sizeof(user_record_t), SEEK_SET) ==
-                0)
-            {
-                if (fread(out, sizeof(system_state_t), 1, file) == 1)
-                {
-                    status = STATUS_OK;
-                }
-                else
-                {
-                    status = STATUS_ERR_STORAGE;
-                }
-            }
-            else
-            {
-                status = STATUS_ERR_STORAGE;
-            }
-            fclose(file);
-        }
-        else
-        {
-            status = STATUS_ERR_STORAGE;
+            status = STATUS_OK;
         }
     }
 
-    if (STATUS_OK == status)
-    {
-        status = system_state_validate_hmac(out);
-    }
-
+    fclose(file);
     return status;
 }
 
-status_t
-hal_storage_set_system_state(system_state_t* in)
+// durable: commit to disk before returning, rather than at the next file_sync
+static status_t
+file_write(const char* relative_path, size_t offset, const void* src, size_t len, bool durable)
 {
-    status_t status = STATUS_ERR_INPUT;
+    char abs_path[MAX_PATH];
+    build_full_path_from_exe_dir(relative_path, abs_path, sizeof(abs_path));
+
+    status_t status = STATUS_ERR_STORAGE;
     FILE*    file   = NULL;
 
-    if (in)
+    if (!src)
     {
-        char abs_path[MAX_PATH];
-        build_full_path_from_exe_dir(STORAGE_FILENAME, abs_path, sizeof(abs_path));
+        return STATUS_ERR_INPUT;
+    }
 
-        ensure_parent_dir_exists(STORAGE_FILENAME);
-        file = fopen(abs_path, "r+b");
-        if (!file)
-        {
-            // Try to create and initialize the file
-            file = fopen(abs_path, "w+b");
-            if (file)
-            {
-                user_record_t blank = {0};
-                for (int i = 0; i < CONFIG_TOTAL_STORAGE_SLOTS; ++i)
-                {
-                    fwrite(&blank, sizeof(user_record_t), 1, file);
-                }
-            }
-        }
+    ensure_parent_dir_exists(relative_path);
+    file = fopen(abs_path, "r+b");
+    if (!file)
+    {
+        return STATUS_ERR_STORAGE;
+    }
 
-        if (file)
+    if (fseek(file, (long) offset, SEEK_SET) == 0)
+    {
+        if (fwrite(src, len, 1, file) == 1)
         {
-            if (fseek(file, CONFIG_STORAGE_INDEX_SYSTEM_STATE * sizeof(user_record_t), SEEK_SET) ==
-                0)
+            fflush(file);
+            if (durable)
             {
-                status_t hmac_status = system_state_compute_hmac(in);
-                if (hmac_status != STATUS_OK)
-                {
-                    status = hmac_status;
-                }
-                else
-                {
-                    if (fwrite(in, sizeof(system_state_t), 1, file) == 1)
-                    {
-                        fflush(file);
-                        _commit(_fileno(file));
-                        status = STATUS_OK;
-                    }
-                    else
-                    {
-                        status = STATUS_ERR_STORAGE;
-                    }
-                }
+                _commit(_fileno(file));
             }
-            else
-            {
-                status = STATUS_ERR_STORAGE;
-            }
-            fclose(file);
-        }
-        else
-        {
-            status = STATUS_ERR_STORAGE;
+            status = STATUS_OK;
         }
     }
 
+    fclose(file);
     return status;
 }
 
-status_t
-hal_storage_log_append(const uint8_t* src, size_t len)
+static status_t
+file_sync(const char* relative_path)
 {
-    if (!src || len != sizeof(log_record_t))
-        return STATUS_ERR_INPUT;
-
     char abs_path[MAX_PATH];
-    build_full_path_from_exe_dir(LOG_STORAGE_FILENAME, abs_path, sizeof(abs_path));
+    build_full_path_from_exe_dir(relative_path, abs_path, sizeof(abs_path));
 
-    FILE* file = fopen(abs_path, "ab"); // Open in append mode
-    if (!file)
-        return STATUS_ERR_INTERNAL;
+    status_t status = STATUS_ERR_STORAGE;
+    FILE*    file   = fopen(abs_path, "r+b");
 
-    size_t written = fwrite(src, 1, len, file);
-    fflush(file);
-    _commit(_fileno(file));
+    if (!file)
+    {
+        return STATUS_ERR_STORAGE;
+    }
+    if (_commit(_fileno(file)) == 0)
+    {
+        status = STATUS_OK;
+    }
 
-    return (written == len) ? STATUS_OK : STATUS_ERR_INTERNAL;
+    fclose(file);
+    return status;
 }
 
-bool
-hal_log_stream_open(log_stream_t* stream)
+static status_t
+file_get_size(const char* relative_path, size_t* out_size)
 {
-    bool result = false;
+    char abs_path[MAX_PATH];
+    build_full_path_from_exe_dir(relative_path, abs_path, sizeof(abs_path));
 
-    if (stream)
+    if (!out_size)
     {
-        char path[MAX_PATH];
-        build_full_path_from_exe_dir(LOG_STORAGE_FILENAME, path, sizeof(path));
+        return STATUS_ERR_INPUT;
+    }
 
-        FILE* f = fopen(path, "rb");
-        if (f)
-        {
-            stream->file = f;
-            result       = true;
-        }
-        else
-        {
-            stream->file = NULL;
-        }
+    FILE* file = fopen(abs_path, "rb");
+    if (!file)
+    {
+        *out_size = 0; // Not created yet
+        return STATUS_OK;
     }
 
-    return result;
-}
+    if (fseek(file, 0, SEEK_END) != 0)
+    {
+        fclose(file);
+        return STATUS_ERR_STORAGE;
+    }
 
-bool
-hal_log_stream_next(log_stream_t* stream, log_record_t* rec)
-{
-    bool result = false;
+    long size = ftell(file);
+    fclose(file);
 
-    if (stream && stream->file && rec)
+    if (size < 0)
     {
-        uint8_t* buffer     = (uint8_t*) rec;
-        size_t   total_read = 0;
+        return STATUS_ERR_STORAGE;
+    }
 
-        // Search for sync byte (0xA5)
-        int c;
-        while ((c = fgetc(stream->file)) != EOF)
-        {
-            if ((uint8_t) c == 0xA5)
-            {
-                buffer[0]  = (uint8_t) c;
-                total_read = 1;
-                break;
-            }
-        }
+    *out_size = (size_t) size;
+    return STATUS_OK;
+}
 
-        // If we never found sync byte
-        if (total_read == 0)
-        {
-            return false;
-        }
+static status_t
+file_resize(const char* relative_path, size_t size)
+{
+    char abs_path[MAX_PATH];
+    build_full_path_from_exe_dir(relative_path, abs_path, sizeof(abs_path));
 
-        // Read the rest of the log record
-        size_t remaining = sizeof(log_record_t) - 1;
-        size_t read      = fread(buffer + 1, 1, remaining, stream->file);
+    status_t status = STATUS_ERR_STORAGE;
 
-        if (read == remaining)
+    ensure_parent_dir_exists(relative_path);
+    FILE* file = fopen(abs_path, "r+b");
+    if (!file)
+    {
+        // Try to create it
+        file = fopen(abs_path, "w+b");
+        if (!file)
         {
-            result = true;
+            return STATUS_ERR_STORAGE;
         }
     }
 
-    return result;
+    // _chsize_s zero-fills when extending
+    if (_chsize_s(_fileno(file), (__int64) size) == 0)
+    {
+        fflush(file);
+        _commit(_fileno(file));
+        status = STATUS_OK;
+    }
+
+    fclose(file);
+    return status;
 }
 
-void
-hal_log_stream_close(log_stream_t* stream)
+// The user/state image and the log ring are both fixed-size files accessed
+// at offsets; every write and resize is committed before returning.
+
+status_t
+hal_storage_raw_read(size_t offset, void* dst, size_t len)
 {
-    if (stream)
-    {
-        if (stream->file)
-        {
-            fclose(stream->file);
-            stream->file = NULL;
-        }
-    }
+    return file_read(STORAGE_FILENAME, offset, dst, len);
 }
 
 status_t
-hal_storage_user_get(uint8_t index, user_record_t* out)
+hal_storage_raw_write(size_t offset, const void* src, size_t len)
 {
-    char abs_path[MAX_PATH];
-    build_full_path_from_exe_dir(STORAGE_FILENAME, abs_path, sizeof(abs_path));
+    return file_write(STORAGE_FILENAME, offset, src, len, false);
+}
 
-    status_t status = STATUS_ERR_STORAGE;
-    FILE*    file   = NULL;
+status_t
+hal_storage_raw_get_size(size_t* out_size)
+{
+    return file_get_size(STORAGE_FILENAME, out_size);
+}
 
-    if (!out || index >= MAX_USERS)
-        return STATUS_ERR_INPUT;
+status_t
+hal_storage_raw_resize(size_t size)
+{
+    return file_resize(STORAGE_FILENAME, size);
+}
 
-    file = fopen(abs_path, "rb");
-    if (!file)
-        return STATUS_ERR_STORAGE;
+status_t
+hal_storage_raw_sync(void)
+{
+    return file_sync(STORAGE_FILENAME);
+}
 
-    if (fseek(file, index * sizeof(user_record_t), SEEK_SET) == 0)
-    {
-        if (fread(out, sizeof(user_record_t), 1, file) == 1)
-        {
-            status = STATUS_OK;
-        }
-    }
+status_t
+hal_storage_log_read(size_t offset, uint8_t* dst, size_t len)
+{
+    return file_read(LOG_STORAGE_FILENAME, offset, dst, len);
+}
 
-    fclose(file);
-    return status;
+status_t
+hal_storage_log_write(size_t offset, const uint8_t* src, size_t len)
+{
+    return file_write(LOG_STORAGE_FILENAME, offset, src, len, true);
+}
+
+status_t
+hal_storage_log_get_size(size_t* out_size)
+{
+    return file_get_size(LOG_STORAGE_FILENAME, out_size);
+}
+
+status_t
+hal_storage_log_resize(size_t size)
+{
+    return file_resize(LOG_STORAGE_FILENAME, size);
 }
 
 status_t
-hal_storage_user_set(uint8_t index, const user_record_t* in)
+hal_storage_log_retire(void)
 {
     char abs_path[MAX_PATH];
-    build_full_path_from_exe_dir(STORAGE_FILENAME, abs_path, sizeof(abs_path));
+    char retired_path[MAX_PATH];
 
-    status_t status = STATUS_ERR_STORAGE;
-    FILE*    file   = NULL;
+    build_full_path_from_exe_dir(LOG_STORAGE_FILENAME, abs_path, sizeof(abs_path));
+    build_full_path_from_exe_dir(LOG_RETIRED_FILENAME, retired_path, sizeof(retired_path));
 
-    if (!in || index >= MAX_USERS)
+    // Without MOVEFILE_REPLACE_EXISTING an existing retired log is kept
+    if (!MoveFileExA(abs_path, retired_path, MOVEFILE_WRITE_THROUGH))
     {
-        return STATUS_ERR_INPUT;
+        return STATUS_ERR_STORAGE;
     }
 
-    ensure_parent_dir_exists(STORAGE_FILENAME);
-    file = fopen(abs_path, "r+b");
-    if (!file)
-    {
-        // Try to create it
-        file = fopen(abs_path, "w+b");
-        if (!file)
-        {
-            return STATUS_ERR_STORAGE;
-        }
+    return STATUS_OK;
+}
 
-        // Initialize with zeros
-        user_record_t blank = {0};
-        for (int i = 0; i < MAX_USERS; ++i)
-        {
-            fwrite(&blank, sizeof(user_record_t), 1, file);
-        }
-    }
+#if CONFIG_LOG_SEGMENT_PAGES > 0
+
+// Sealed segments: one file each, written once, then only read or removed
+
+static void
+segment_path(uint32_t segment, char* out, size_t out_len)
+{
+    snprintf(out, out_len, LOG_SEGMENT_DIR "%08" PRIx32 ".seg", segment);
+}
+
+static bool
+file_exists(const char* relative_path)
+{
+    char abs_path[MAX_PATH];
+    build_full_path_from_exe_dir(relative_path, abs_path, sizeof(abs_path));
 
-    if (fseek(file, index * sizeof(user_record_t), SEEK_SET) == 0)
+    return _access(abs_path, 0) == 0;
+}
+
+// Create an empty file if there is none yet; never truncates
+static status_t
+file_create(const char* relative_path)
+{
+    char abs_path[MAX_PATH];
+    build_full_path_from_exe_dir(relative_path, abs_path, sizeof(abs_path));
+
+    ensure_parent_dir_exists(relative_path);
+    FILE* file = fopen(abs_path, "ab");
+    if (!file)
     {
-        if (fwrite(in, sizeof(user_record_t), 1, file) == 1)
-        {
-            status = STATUS_OK;
-        }
+        return STATUS_ERR_STORAGE;
     }
 
     fclose(file);
-    return status;
+    return STATUS_OK;
 }
 
 status_t
-hal_storage_log_get_size(size_t* out_size)
+hal_storage_segment_write(uint32_t segment, size_t offset, const uint8_t* src, size_t len)
 {
-    if (!out_size)
+    char path[MAX_PATH];
+    segment_path(segment, path, sizeof(path));
+
+    status_t status = file_create(path);
+    if (status == STATUS_OK)
     {
-        return STATUS_ERR_INPUT;
+        status = file_write(path, offset, src, len, true);
     }
 
-    FILE* file = fopen(LOG_STORAGE_FILENAME, "rb");
-    if (!file)
+    return status;
+}
+
+status_t
+hal_storage_segment_read(uint32_t segment, size_t offset, uint8_t* dst, size_t len)
+{
+    char path[MAX_PATH];
+    segment_path(segment, path, sizeof(path));
+
+    if (!file_exists(path))
     {
-        return STATUS_ERR_STORAGE;
+        return STATUS_ERR_NOT_FOUND;
     }
 
-    if (fseek(file, 0, SEEK_END) != 0)
+    return file_read(path, offset, dst, len);
+}
+
+status_t
+hal_storage_segment_remove(uint32_t segment)
+{
+    char path[MAX_PATH];
+    char abs_path[MAX_PATH];
+
+    segment_path(segment, path, sizeof(path));
+    build_full_path_from_exe_dir(path, abs_path, sizeof(abs_path));
+
+    if (!file_exists(path))
     {
-        fclose(file);
-        return STATUS_ERR_STORAGE;
+        return STATUS_ERR_NOT_FOUND;
     }
 
-    long size = ftell(file);
-    fclose(file);
+    return (remove(abs_path) == 0) ? STATUS_OK : STATUS_ERR_STORAGE;
+}
 
-    if (size < 0)
+status_t
+hal_storage_segment_index_write(size_t offset, const uint8_t* src, size_t len)
+{
+    status_t status = file_create(LOG_SEGMENT_INDEX_FILENAME);
+
+    if (status == STATUS_OK)
     {
-        return STATUS_ERR_STORAGE;
+        status = file_write(LOG_SEGMENT_INDEX_FILENAME, offset, src, len, true);
     }
 
-    *out_size = (size_t) size;
-    return STATUS_OK;
+    return status;
+}
+
+status_t
+hal_storage_segment_index_read(size_t offset, uint8_t* dst, size_t len)
+{
+    return file_read(LOG_SEGMENT_INDEX_FILENAME, offset, dst, len);
 }
 
+status_t
+hal_storage_segment_index_get_size(size_t* out_size)
+{
+    return file_get_size(LOG_SEGMENT_INDEX_FILENAME, out_size);
+}
+
+#endif // CONFIG_LOG_SEGMENT_PAGES
+
 #endif // PLATFORM_WINDOWS
\ No newline at end of file
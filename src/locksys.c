@@ -10,19 +10,7 @@
 
 // --- Internal (static) function declarations ---
 static status_t
-locksys_check_passphrase(const char* username, char* passphrase);
-static status_t
-locksys_set_failed_attempts(const char* username, uint8_t count);
-static status_t
-locksys_get_failed_attempts(const char* username, uint8_t* out);
-static status_t
-locksys_set_permanently_locked(const char* username, bool value);
-static status_t
-locksys_get_permanently_locked(const char* username, bool* out);
-static status_t
-locksys_set_hash(const char* username, const uint8_t* hash);
-static status_t
-locksys_get_hash(const char* username, uint8_t* out);
+locksys_check_passphrase(user_txn_t* txn, char* passphrase);
 static status_t
 throttle_check_and_register_attempt(void);
 static status_t
@@ -34,12 +22,19 @@ locksys_init(void)
     status_t      status  = STATUS_OK;
     uint8_t       version = APP_VERSION;
     user_record_t admin   = {0};
-    uint8_t       index   = 0;
+    user_index_t  index   = 0;
+
+    if (crypto_self_test() != STATUS_OK)
+    {
+        return STATUS_ERR_INTERNAL;
+    }
 
     log_init();
     log_write(EVENT_APPLICATION_START, &version, sizeof(version));
+    log_commit();
     // log_dump();
 
+    user_index_build();
     status = user_find_by_username(ROOT_ADMIN_USERNAME, &index, &admin);
     if (status != STATUS_OK || user_record_validate_hmac(&admin) != STATUS_OK)
     {
@@ -49,20 +44,14 @@ locksys_init(void)
     return status;
 }
 
+// Checks the passphrase against the record held by an open transaction and
+// updates its counters / lock flag in memory; the caller commits.
 static status_t
-locksys_check_passphrase(const char* username, char* passphrase)
+locksys_check_passphrase(user_txn_t* txn, char* passphrase)
 {
-    status_t rtn_status     = STATUS_OK;
-    bool     is_perm_locked = false;
-
-    status_t status = status = locksys_get_permanently_locked(username, &is_perm_locked);
+    status_t rtn_status = STATUS_OK;
 
-    if (STATUS_OK != status)
-    {
-        secure_zero(passphrase, strnlen(passphrase, CONFIG_MAX_PASSWORD_LENGTH + 1));
-        rtn_status = status;
-    }
-    else if (is_perm_locked)
+    if ((txn->counters.flags & USER_FLAG_IS_LOCKED) != 0)
     {
         secure_zero(passphrase, strnlen(passphrase, CONFIG_MAX_PASSWORD_LENGTH + 1));
         rtn_status = STATUS_ERR_PERM_LOCKED;
@@ -75,29 +64,30 @@ locksys_check_passphrase(const char* username, char* passphrase)
                               sizeof(entered_hash));
         secure_zero(passphrase, strnlen(passphrase, CONFIG_MAX_PASSWORD_LENGTH + 1));
 
-        uint8_t hash[LOCKSYS_HASH_SIZE];
-        locksys_get_hash(username, hash);
-        status = secure_compare(entered_hash, hash, LOCKSYS_HASH_SIZE);
-        secure_zero(hash, sizeof(hash));
+        status_t status =
+            secure_compare(entered_hash, txn->record.password_hmac, LOCKSYS_HASH_SIZE);
         secure_zero(entered_hash, sizeof(entered_hash));
         if (STATUS_OK == status)
         {
-            locksys_set_failed_attempts(username, 0);
+            if (txn->counters.failed_attempts_since_login != 0)
+            {
+                txn->counters.failed_attempts_since_login = 0;
+                txn->counters_dirty                       = true;
+            }
             throttle_reset();
             rtn_status = STATUS_OK;
         }
         else
         {
-            uint8_t failed_attempts = 0;
-            locksys_get_failed_attempts(username, &failed_attempts);
-            locksys_set_failed_attempts(username, ++failed_attempts);
+            txn->counters.failed_attempts_since_login++;
+            txn->counters.last_attempt_timestamp = hal_get_timestamp();
+            txn->counters_dirty                  = true;
 
             rtn_status = STATUS_ERR_AUTH;
 
-            locksys_get_failed_attempts(username, &failed_attempts);
-            if (failed_attempts >= LOCKSYS_MAX_ATTEMPTS)
+            if (txn->counters.failed_attempts_since_login >= LOCKSYS_MAX_ATTEMPTS)
             {
-                locksys_set_permanently_locked(username, true);
+                txn->counters.flags |= USER_FLAG_IS_LOCKED;
                 rtn_status = STATUS_ERR_PERM_LOCKED;
             }
         }
@@ -142,7 +132,12 @@ locksys_reset_passphrase(const char* username, char* current_passphrase, char* n
 
     log_write(EVENT_REQUEST_TO_UNLOCK, 0, 0);
 
-    status = locksys_check_passphrase(username, current_passphrase);
+    user_txn_t txn;
+    status = user_txn_begin(username, &txn);
+    if (status == STATUS_OK)
+    {
+        status = locksys_check_passphrase(&txn, current_passphrase);
+    }
     secure_zero(current_passphrase,
                 strnlen(current_passphrase,
                         CONFIG_MAX_PASSWORD_LENGTH + 1)); // Always clear sensitive input
@@ -158,13 +153,16 @@ locksys_reset_passphrase(const char* username, char* current_passphrase, char* n
 
         if (status == STATUS_OK)
         {
-            status = locksys_set_hash(username, new_hash);
+            memcpy(txn.record.password_hmac, new_hash, LOCKSYS_HASH_SIZE);
+            txn.record.password_last_set = hal_get_timestamp();
+            txn.dirty                    = true;
             secure_zero(new_hash, sizeof(new_hash));
         }
 
+        status_t commit_status = user_txn_commit(&txn);
         if (status == STATUS_OK)
         {
-            status = locksys_set_failed_attempts(username, 0);
+            status = commit_status;
         }
 
         if (status == STATUS_OK)
@@ -175,13 +173,16 @@ locksys_reset_passphrase(const char* username, char* current_passphrase, char* n
         {
             log_write(EVENT_PASS_CHANGE_FAILED, (const uint8_t*) &status, sizeof(status));
         }
+        log_commit();
     }
     else
     {
+        user_txn_commit(&txn); // persist the failed attempt
         secure_zero(new_passphrase,
                     strnlen(new_passphrase,
                             CONFIG_MAX_PASSWORD_LENGTH + 1)); // clear on failure too
         log_write(EVENT_PASS_CHANGE_FAILED, (const uint8_t*) &status, sizeof(status));
+        log_commit();
     }
 
     return status;
@@ -212,15 +213,37 @@ locksys_open_lock(const char* username, char* passphrase)
     // log_dump();
     log_write(EVENT_REQUEST_TO_UNLOCK, 0, 0);
 
-    status = locksys_check_passphrase(username, passphrase);
+    user_txn_t txn;
+    status = user_txn_begin(username, &txn);
+    if (STATUS_OK == status)
+    {
+        status = locksys_check_passphrase(&txn, passphrase);
+
+        status_t commit_status = user_txn_commit(&txn);
+        if (STATUS_OK == status)
+        {
+            status = commit_status;
+        }
+    }
+    else
+    {
+        secure_zero(passphrase, strnlen(passphrase, CONFIG_MAX_PASSWORD_LENGTH + 1));
+    }
+
     if (STATUS_OK == status)
     {
         log_write(EVENT_UNLOCKING_DEVICE, 0, 0);
+#if defined(CONFIG_LOG_ASYNC)
+        log_commit(); // Queued; the writer thread persists it off this path
+#else
+        log_flush(); // The unlock is on record before the lock moves
+#endif
         status = hal_lock_open();
     }
     else
     {
         log_write(EVENT_UNLOCK_CHECK_FAILED, (const uint8_t*) &status, sizeof(status));
+        log_commit();
     }
     return status;
 }
@@ -229,166 +252,38 @@ status_t
 locksys_close_lock()
 {
     log_write(EVENT_LOCKING_DEVICE, 0, 0);
+    log_commit();
     return hal_lock_close();
 }
 
 status_t
 locksys_step()
 {
-    //  Optional: for future timing logic like temporary lockouts
-    return STATUS_OK;
-}
-
-static status_t
-locksys_set_failed_attempts(const char* username, uint8_t count)
-{
-    status_t      status = STATUS_OK;
-    user_record_t user   = {0};
-    uint8_t       index  = 0;
-
-    if (!username)
-    {
-        status = STATUS_ERR_INPUT;
-    }
-    else
-    {
-        status = user_find_by_username(username, &index, &user);
-        if (status == STATUS_OK)
-        {
-            user.failed_attempts_since_login = count;
-            user_record_compute_hmac(&user);
-            status = hal_storage_user_set(index, &user);
-        }
-    }
-
-    return status;
-}
-
-static status_t
-locksys_get_failed_attempts(const char* username, uint8_t* out)
-{
-    status_t      status = STATUS_OK;
-    user_record_t user   = {0};
-    uint8_t       index  = 0;
-
-    if (!username || !out)
-    {
-        status = STATUS_ERR_INPUT;
-    }
-    else
-    {
-        status = user_find_by_username(username, &index, &user);
-        if (status == STATUS_OK)
-        {
-            *out = user.failed_attempts_since_login;
-        }
-    }
+    status_t status = STATUS_OK;
 
-    return status;
-}
-
-static status_t
-locksys_set_permanently_locked(const char* username, bool locked)
-{
-    status_t      status = STATUS_OK;
-    user_record_t user   = {0};
-    uint8_t       index  = 0;
-
-    if (!username)
-    {
-        status = STATUS_ERR_INPUT;
-    }
-    else
-    {
-        status = user_find_by_username(username, &index, &user);
-        if (status == STATUS_OK)
-        {
-            if (locked)
-            {
-                user.user_flags |= USER_FLAG_IS_LOCKED;
-            }
-            else
-            {
-                user.user_flags &= ~USER_FLAG_IS_LOCKED;
-            }
-            user_record_compute_hmac(&user);
-            status = hal_storage_user_set(index, &user);
-        }
-    }
-
-    return status;
-}
-
-static status_t
-locksys_get_permanently_locked(const char* username, bool* out)
-{
-    status_t      status = STATUS_OK;
-    user_record_t user   = {0};
-    uint8_t       index  = 0;
+    //  Optional: for future timing logic like temporary lockouts
+#if CONFIG_USER_COMPACT_MOVES_PER_STEP > 0
+    status = user_compact_step(CONFIG_USER_COMPACT_MOVES_PER_STEP, NULL);
+#endif
 
-    if (!username || !out)
-    {
-        status = STATUS_ERR_INPUT;
-    }
-    else
+    if (status == STATUS_OK)
     {
-        status = user_find_by_username(username, &index, &user);
-        if (status == STATUS_OK)
-        {
-            *out = (user.user_flags & USER_FLAG_IS_LOCKED) != 0;
-        }
+        status = user_cache_step(hal_get_timestamp());
     }
 
-    return status;
-}
-
-static status_t
-locksys_set_hash(const char* username, const uint8_t* hash)
-{
-    status_t      status = STATUS_OK;
-    user_record_t user   = {0};
-    uint8_t       index  = 0;
-
-    if (!username || !hash)
+    status_t log_status = log_step();
+    if (status == STATUS_OK)
     {
-        status = STATUS_ERR_INPUT;
-    }
-    else
-    {
-        status = user_find_by_username(username, &index, &user);
-        if (status == STATUS_OK)
-        {
-            memcpy(user.password_hmac, hash, LOCKSYS_HASH_SIZE);
-            user.password_last_set = hal_get_timestamp();
-            user_record_compute_hmac(&user);
-            status = hal_storage_user_set(index, &user);
-        }
+        status = log_status;
     }
 
     return status;
 }
 
-static status_t
-locksys_get_hash(const char* username, uint8_t* out)
+status_t
+locksys_shutdown()
 {
-    status_t      status = STATUS_OK;
-    user_record_t user   = {0};
-    uint8_t       index  = 0;
-
-    if (!username || !out)
-    {
-        status = STATUS_ERR_INPUT;
-    }
-    else
-    {
-        status = user_find_by_username(username, &index, &user);
-        if (status == STATUS_OK)
-        {
-            memcpy(out, user.password_hmac, LOCKSYS_HASH_SIZE);
-        }
-    }
-
-    return status;
+    return log_shutdown();
 }
 
 static status_t
@@ -15,6 +15,8 @@ status_t locksys_init();
 
 status_t locksys_step();
 
+status_t locksys_shutdown();
+
 status_t locksys_open_lock(const char* username, char* passphrase);
 
 status_t locksys_close_lock();
@@ -1,5 +1,6 @@
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -11,87 +12,2161 @@
 #include "hal/hal_time.h"
 #include "logging/logging.h"
 
-struct log_stream_t
+#if defined(CONFIG_LOG_ASYNC)
+#if !defined(PLATFORM_POSIX)
+#error "CONFIG_LOG_ASYNC needs POSIX threads"
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#endif
+
+// The log file starts with a MAC'd log_file_header_t and two checkpoint
+// slots, followed by a ring of CONFIG_LOG_PAGE_COUNT pages of
+// CONFIG_LOG_PAGE_SIZE bytes. Each page holds a
+// MAC'd log_page_header_t, then frames, then zero padding. Page sequence
+// numbers start at 1 and grow by one per page, and sequence s lives in slot
+// (s - 1) % CONFIG_LOG_PAGE_COUNT. The slots therefore hold a rotated
+// ascending run, and the oldest page is found by binary search. When the
+// ring is full, the next page overwrites the oldest one.
+//
+// Frame, variable length:
+//
+//   sync      1 byte, always LOG_SYNC_BYTE
+//   length    varint, bytes in the body
+//   body      varint timestamp delta (zigzag, from the previous frame in the
+//             page or from the page base timestamp), 1 byte type, payload
+//   tag       LOG_TAG_SIZE bytes, truncated HMAC over the LOG_TAG_SIZE bytes
+//             before the frame, sync, length and body
+//
+// The bytes before a frame are the tag of the frame before it, or the page
+// header's own tag for the first frame, so tags form a chain through the
+// page. Each page header in turn carries the last tag of the page before it
+// (its link). Dropping, reordering or truncating frames breaks the chain at
+// the next frame or page, and every page can be verified on its own before
+// the links between pages are compared.
+//
+// A checkpoint records the append position (page sequence and bytes used),
+// the delta base, the last tag and the event counters up to that point. The
+// slots are written alternately and the newer authentic one wins, so boot
+// only reads what was appended after it.
+//
+// With CONFIG_LOG_SEGMENT_PAGES, the ring is also cut into segments of that
+// many pages, aligned on sequence numbers. Once a segment is complete, and
+// at the latest just before the ring overwrites it, its pages are copied to
+// a numbered segment file followed by a seal: counts, the tags at both ends
+// and a MAC. The seal also goes into an index at position number * size,
+// so dropped or reordered seals show as a numbering gap.
+//
+// Varints are LEB128. Frames never cross a page, so a reader loads one whole
+// page per read and decodes from memory. It resynchronises on the next sync
+// byte (memchr) whenever a frame does not authenticate. A zero byte where a
+// frame should start ends the page.
+//
+// With CONFIG_LOG_ASYNC, log_write only copies the event into a bounded
+// lock-free queue (one sequence number per slot, producers claim tickets
+// with a CAS). A writer thread drains it, encodes and MACs the frames, and
+// flushes once per drained batch. Everything below that touches the append
+// position runs on that thread or under log_state_mutex.
+
+#define LOG_MAGIC 0x474F4C4Cu // "LLOG"
+// Bump on any change to the file, page or frame layout, and migrate files of
+// the previous version in log_scan. Without a migration such a file is set
+// aside (LOG_DISCARD_VERSION).
+//   Version 1: checkpoints without the event counters (log_stats_t), so the
+//   pages started earlier in the file.
+#define LOG_FORMAT_VERSION 2
+#define LOG_SYNC_BYTE 0xA5
+#define LOG_VARINT_MAX 5
+#define LOG_BODY_MAX (LOG_VARINT_MAX + 1 + LOG_MAX_PAYLOAD)
+#define LOG_FRAME_MAX (1 + 2 + LOG_BODY_MAX + LOG_TAG_SIZE)
+
+// Written when the file is formatted. Its layout never changes, so any
+// later version can tell which format a file is in.
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint16_t version;    // LOG_FORMAT_VERSION
+    uint16_t page_size;  // CONFIG_LOG_PAGE_SIZE
+    uint32_t page_count; // CONFIG_LOG_PAGE_COUNT
+    uint8_t  tag[LOG_TAG_SIZE];
+} log_file_header_t;
+
+typedef struct __attribute__((packed))
+{
+    uint32_t seq;
+    uint32_t base_timestamp;     // Delta base of the first frame in the page
+    uint8_t  link[LOG_TAG_SIZE]; // Last tag of the previous page
+    uint8_t  tag[LOG_TAG_SIZE];  // Must stay last: the first frame chains from it
+} log_page_header_t;
+
+// A point in the log between two frames
+typedef struct __attribute__((packed))
+{
+    uint32_t seq;       // Page sequence number
+    uint32_t used;      // Bytes of that page covered, header included
+    uint32_t timestamp; // Delta base for the next frame
+    uint8_t  last[LOG_TAG_SIZE];
+} log_position_t;
+
+typedef struct __attribute__((packed))
+{
+    uint32_t       generation; // The newer of two authentic slots wins
+    log_position_t pos;
+    log_stats_t    stats; // Covering every frame up to pos
+    uint8_t        tag[LOG_TAG_SIZE];
+} log_checkpoint_t;
+
+#define LOG_CHECKPOINT_SLOTS 2
+#define LOG_CHECKPOINTS_OFFSET sizeof(log_file_header_t)
+#define LOG_CHECKPOINT_OFFSET(i) (LOG_CHECKPOINTS_OFFSET + (size_t) (i) * sizeof(log_checkpoint_t))
+#define LOG_PAGES_OFFSET LOG_CHECKPOINT_OFFSET(LOG_CHECKPOINT_SLOTS)
+#define LOG_FILE_SIZE (LOG_PAGES_OFFSET + (size_t) CONFIG_LOG_PAGE_SIZE * CONFIG_LOG_PAGE_COUNT)
+#define LOG_PAGE_OFFSET(slot) (LOG_PAGES_OFFSET + (size_t) (slot) * CONFIG_LOG_PAGE_SIZE)
+#define LOG_PAGE_DATA (CONFIG_LOG_PAGE_SIZE - sizeof(log_page_header_t))
+
+#if LOG_MAX_PAYLOAD > 255 || LOG_BODY_MAX >= (1 << 14)
+#error "LOG_MAX_PAYLOAD must fit a byte and the body length a two-byte varint"
+#endif
+#if CONFIG_LOG_BUFFER_BYTES < LOG_FRAME_MAX
+#error "CONFIG_LOG_BUFFER_BYTES must hold at least one maximum-size frame"
+#endif
+
+_Static_assert(CONFIG_LOG_PAGE_COUNT >= 2 && LOG_PAGE_DATA >= LOG_FRAME_MAX,
+               "The log ring needs at least two pages, each holding a maximum-size frame");
+_Static_assert(offsetof(log_page_header_t, tag) + LOG_TAG_SIZE == sizeof(log_page_header_t),
+               "The page header tag must immediately precede the first frame");
+
+#if CONFIG_LOG_SEGMENT_PAGES > 0
+_Static_assert(CONFIG_LOG_PAGE_COUNT % CONFIG_LOG_SEGMENT_PAGES == 0 &&
+                   CONFIG_LOG_PAGE_COUNT >= 2 * CONFIG_LOG_SEGMENT_PAGES,
+               "The log ring must hold a whole number of segments, at least two");
+
+// Trailer of a segment file and entry of the segment index
+typedef struct __attribute__((packed))
+{
+    uint32_t segment;            // Archive number, one per sealed segment
+    uint32_t first_seq;          // Ring sequence of the first page
+    uint32_t pages;              // CONFIG_LOG_SEGMENT_PAGES when sealed
+    uint32_t records;            // Authentic frames
+    uint32_t skipped;            // Bytes that did not authenticate when sealed
+    uint8_t  link[LOG_TAG_SIZE]; // First page's link to the page before
+    uint8_t  last[LOG_TAG_SIZE]; // Last tag of the final page
+    uint8_t  tag[LOG_TAG_SIZE];
+} log_segment_seal_t;
+#endif
+
+typedef enum
+{
+    LOG_PAGE_BLANK,
+    LOG_PAGE_VALID,
+    LOG_PAGE_INVALID,
+} log_page_state_t;
+
+// Where the ring currently starts and ends
+typedef struct
+{
+    uint32_t          oldest;    // Slot of the oldest page
+    uint32_t          pages;     // Slots to visit from oldest (0 = empty ring)
+    uint32_t          head_slot; // Slot of the newest page
+    log_page_header_t head;      // Its header (seq 0 = no page written yet)
+} log_ring_t;
+
+// Frames of one page held in memory
+typedef struct
+{
+    const uint8_t* page;      // Whole page, header included
+    size_t         start;     // Next unconsumed byte
+    size_t         end;       // End of the bytes still to decode
+    uint32_t       timestamp; // Of the last authentic frame, or the page base
+    uint8_t        last[LOG_TAG_SIZE]; // Tag of the last authentic frame, or the header's
+    size_t         skipped;            // Bytes passed over in this page
+} log_cursor_t;
+
+// Sequential frame reader over the ring, oldest page first
+typedef struct
+{
+    log_ring_t   ring;
+    uint32_t     visited; // Pages of ring.pages opened so far
+    uint32_t     page_seq;
+    uint8_t      page[CONFIG_LOG_PAGE_SIZE];
+    log_cursor_t cursor;
+    size_t       skipped; // Bytes passed over since the last frame returned
+} log_reader_t;
+
+static const uint8_t log_blank_page[LOG_PAGE_DATA];
+
+static uint8_t  log_buffer[CONFIG_LOG_BUFFER_BYTES];
+static size_t   log_buffered       = 0;
+static uint32_t log_last_timestamp = 0; // Delta base for the next frame
+static uint32_t log_head_slot      = 0;
+static uint32_t log_head_seq       = 0; // 0 until the first page is opened
+static size_t   log_page_used      = 0; // Bytes of the head page on disk
+static uint8_t  log_prev_tag[LOG_TAG_SIZE]; // Chained into the next frame or page
+static uint32_t log_checkpoint_generation = 0;
+static uint32_t log_checkpoint_seq        = 0; // Position the last checkpoint recorded
+static size_t   log_checkpoint_used       = 0;
+static bool     log_ready                 = false;
+
+static log_position_t log_verified; // Where the last log_verify() stopped (seq 0 = nowhere)
+static log_stats_t    log_stats;    // Every frame appended, buffered ones included
+
+// Sparse query index: one entry per ring slot, summarising the authentic
+// frames of the page in it, so log_query only reads pages that can match
+typedef struct
+{
+    uint32_t seq;    // Page the entry describes (0 = none)
+    uint32_t min_ts; // Earliest and latest frame timestamps
+    uint32_t max_ts;
+    uint32_t types; // LOG_EVENT_BIT of every frame type
+    status_t status; // Why the page could not be indexed in full, if it could not
+} log_page_index_t;
+
+#if CONFIG_LOG_SEGMENT_PAGES > 0
+static uint32_t           log_segment_number = 0; // Archive number of the next seal
+static uint32_t           log_segment_seq    = 1; // First page not yet sealed or given up
+static uint32_t           log_segments_checked = 0; // Seals log_verify_segments has passed
+static log_segment_seal_t log_segments_prev;        // The last of those (pages 0 = none)
+#endif
+
+static log_page_index_t log_index[CONFIG_LOG_PAGE_COUNT];
+static bool             log_index_ready = false; // Built on the first query
+
+#if defined(CONFIG_LOG_ASYNC)
+_Static_assert((CONFIG_LOG_QUEUE_DEPTH & (CONFIG_LOG_QUEUE_DEPTH - 1)) == 0,
+               "CONFIG_LOG_QUEUE_DEPTH must be a power of two");
+
+// One queued event. seq == ticket: free for that ticket's producer;
+// seq == ticket + 1: published, ready for the writer.
+typedef struct
+{
+    _Atomic uint32_t seq;
+    uint32_t         timestamp; // Taken by the caller, not the writer
+    uint8_t          type;
+    uint8_t          payload_len;
+    uint8_t          payload[LOG_MAX_PAYLOAD];
+} log_queue_slot_t;
+
+static log_queue_slot_t log_queue[CONFIG_LOG_QUEUE_DEPTH];
+static _Atomic uint32_t log_enqueue_pos = 0; // Next ticket handed to a producer
+static uint32_t         log_dequeue_pos = 0; // Writer thread only
+
+static _Atomic bool log_writer_running       = false;
+static _Atomic bool log_writer_idle          = false; // Parked on log_work_cond
+static _Atomic bool log_maintain_requested = false;
+
+// Guards the wait conditions below; never held across storage I/O
+static pthread_mutex_t log_async_mutex   = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  log_work_cond     = PTHREAD_COND_INITIALIZER; // Writer waits here
+static pthread_cond_t  log_progress_cond = PTHREAD_COND_INITIALIZER; // Producers, barriers
+static uint32_t        log_done_pos      = 0;     // Tickets appended and flushed
+static status_t        log_async_status  = STATUS_OK; // First writer error since the last barrier
+static bool            log_writer_stop   = false;
+static pthread_t       log_writer;
+
+// Held by whoever touches the append position and ring state
+static pthread_mutex_t log_state_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define LOG_STATE_LOCK() pthread_mutex_lock(&log_state_mutex)
+#define LOG_STATE_UNLOCK() pthread_mutex_unlock(&log_state_mutex)
+#else
+#define LOG_STATE_LOCK() ((void) 0)
+#define LOG_STATE_UNLOCK() ((void) 0)
+#endif
+
+static size_t
+varint_put(uint8_t* out, uint32_t value)
+{
+    size_t len = 0;
+
+    while (value >= 0x80)
+    {
+        out[len++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    out[len++] = (uint8_t) value;
+
+    return len;
+}
+
+static bool
+varint_get(const uint8_t* in, size_t avail, uint32_t* out_value, size_t* out_len)
+{
+    uint32_t value = 0;
+
+    for (size_t i = 0; i < avail && i < LOG_VARINT_MAX; ++i)
+    {
+        value |= (uint32_t) (in[i] & 0x7F) << (7 * i);
+        if ((in[i] & 0x80) == 0)
+        {
+            *out_value = value;
+            *out_len   = i + 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static status_t
+compute_tag(const uint8_t* frame, size_t len, uint8_t* out_tag)
+{
+    uint8_t  mac[LOCKSYS_HASH_SIZE];
+    status_t status = compute_internal_hmac(frame, len, mac, sizeof(mac));
+
+    memcpy(out_tag, mac, LOG_TAG_SIZE);
+    secure_zero(mac, sizeof(mac));
+
+    return status;
+}
+
+// Tag of a frame chained from prev_tag, without first copying the two together
+static status_t
+frame_tag(const uint8_t* prev_tag, const uint8_t* frame, size_t len, uint8_t* out_tag)
+{
+    hmac_sha256_ctx_t ctx;
+    uint8_t           mac[LOCKSYS_HASH_SIZE] = {0};
+    status_t          status = compute_internal_hmac_init(&ctx);
+
+    if (status == STATUS_OK)
+    {
+        hmac_sha256_update(&ctx, prev_tag, LOG_TAG_SIZE);
+        hmac_sha256_update(&ctx, frame, len);
+        status = hmac_sha256_final(&ctx, mac);
+    }
+
+    memcpy(out_tag, mac, LOG_TAG_SIZE);
+    secure_zero(mac, sizeof(mac));
+
+    return status;
+}
+
+// Encode one frame and its tag into out (LOG_FRAME_MAX bytes), chained from
+// log_prev_tag; returns the length including the tag, or 0 on failure
+static size_t
+encode_frame(uint8_t*       out,
+             uint32_t       timestamp,
+             uint8_t        type,
+             const uint8_t* payload,
+             size_t         payload_len)
+{
+    int32_t  delta = (int32_t) (timestamp - log_last_timestamp);
+    uint32_t zz    = ((uint32_t) delta << 1) ^ (uint32_t) (delta >> 31);
+    uint8_t  delta_buf[LOG_VARINT_MAX];
+    size_t   delta_len = varint_put(delta_buf, zz);
+    size_t   pos       = 0;
+
+    out[pos++] = LOG_SYNC_BYTE;
+    pos += varint_put(out + pos, (uint32_t) (delta_len + 1 + payload_len));
+    memcpy(out + pos, delta_buf, delta_len);
+    pos += delta_len;
+    out[pos++] = type;
+    if (payload_len > 0)
+    {
+        memcpy(out + pos, payload, payload_len);
+        pos += payload_len;
+    }
+
+    if (frame_tag(log_prev_tag, out, pos, out + pos) != STATUS_OK)
+    {
+        return 0;
+    }
+
+    return pos + LOG_TAG_SIZE;
+}
+
+static log_page_state_t
+page_header_check(uint32_t slot, const log_page_header_t* hdr)
+{
+    static const log_page_header_t blank = {0};
+    uint8_t                        tag[LOG_TAG_SIZE];
+
+    if (memcmp(hdr, &blank, sizeof(*hdr)) == 0)
+    {
+        return LOG_PAGE_BLANK;
+    }
+    if (compute_tag((const uint8_t*) hdr, offsetof(log_page_header_t, tag), tag) != STATUS_OK ||
+        secure_compare(tag, hdr->tag, LOG_TAG_SIZE) != STATUS_OK || hdr->seq == 0 ||
+        (hdr->seq - 1) % CONFIG_LOG_PAGE_COUNT != slot)
+    {
+        return LOG_PAGE_INVALID;
+    }
+
+    return LOG_PAGE_VALID;
+}
+
+static log_page_state_t
+page_header_read(uint32_t slot, log_page_header_t* hdr)
+{
+    if (hal_storage_log_read(LOG_PAGE_OFFSET(slot), (uint8_t*) hdr, sizeof(*hdr)) != STATUS_OK)
+    {
+        return LOG_PAGE_INVALID;
+    }
+
+    return page_header_check(slot, hdr);
+}
+
+// Find the oldest and newest pages with O(log n) header reads. A header that
+// does not authenticate breaks the ordering, so fall back to a linear scan.
+static void
+ring_locate(log_ring_t* ring)
+{
+    log_page_header_t first;
+    log_page_header_t hdr;
+    log_page_state_t  state = page_header_read(0, &first);
+
+    memset(ring, 0, sizeof(*ring));
+
+    if (state == LOG_PAGE_BLANK)
+    {
+        return;
+    }
+
+    if (state == LOG_PAGE_VALID)
+    {
+        // First slot whose page is not newer than slot 0
+        uint32_t lo = 1;
+        uint32_t hi = CONFIG_LOG_PAGE_COUNT;
+
+        while (lo < hi && state != LOG_PAGE_INVALID)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+
+            state = page_header_read(mid, &hdr);
+            if (state == LOG_PAGE_VALID && hdr.seq > first.seq)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+
+        if (state != LOG_PAGE_INVALID && page_header_read(lo - 1, &ring->head) == LOG_PAGE_VALID)
+        {
+            ring->head_slot = lo - 1;
+            if (lo == CONFIG_LOG_PAGE_COUNT || page_header_read(lo, &hdr) == LOG_PAGE_BLANK)
+            {
+                ring->oldest = 0;
+                ring->pages  = lo;
+            }
+            else
+            {
+                ring->oldest = lo;
+                ring->pages  = CONFIG_LOG_PAGE_COUNT;
+            }
+            return;
+        }
+    }
+
+    memset(&ring->head, 0, sizeof(ring->head));
+    for (uint32_t slot = 0; slot < CONFIG_LOG_PAGE_COUNT; ++slot)
+    {
+        if (page_header_read(slot, &hdr) == LOG_PAGE_VALID && hdr.seq > ring->head.seq)
+        {
+            ring->head      = hdr;
+            ring->head_slot = slot;
+        }
+    }
+    ring->oldest = (ring->head_slot + 1) % CONFIG_LOG_PAGE_COUNT;
+    ring->pages  = CONFIG_LOG_PAGE_COUNT;
+}
+
+static void
+reader_open(log_reader_t* reader)
+{
+    memset(reader, 0, sizeof(*reader));
+    ring_locate(&reader->ring);
+}
+
+// Position the cursor at the first frame of a page whose header is valid
+static void
+cursor_open(log_cursor_t* cursor, const uint8_t* page, const log_page_header_t* hdr)
+{
+    cursor->page      = page;
+    cursor->start     = sizeof(*hdr);
+    cursor->end       = CONFIG_LOG_PAGE_SIZE;
+    cursor->timestamp = hdr->base_timestamp;
+    cursor->skipped   = 0;
+    memcpy(cursor->last, hdr->tag, LOG_TAG_SIZE);
+}
+
+// Decode the frame at the cursor; returns its length or 0. The tag covers
+// the LOG_TAG_SIZE bytes before the frame, which are always inside the page.
+static size_t
+cursor_decode(const log_cursor_t* cursor, size_t avail, log_record_t* rec)
+{
+    const uint8_t* frame    = cursor->page + cursor->start;
+    uint32_t       body_len = 0;
+    uint32_t       zz       = 0;
+    size_t         len_len  = 0;
+    size_t         zz_len   = 0;
+    uint8_t        tag[LOG_TAG_SIZE];
+
+    if (!varint_get(frame + 1, avail - 1, &body_len, &len_len) || body_len > LOG_BODY_MAX)
+    {
+        return 0;
+    }
+
+    size_t head = 1 + len_len;
+    if (avail < head + body_len + LOG_TAG_SIZE)
+    {
+        return 0; // Torn or bogus length
+    }
+    if (!varint_get(frame + head, body_len, &zz, &zz_len) || zz_len + 1 > body_len)
+    {
+        return 0;
+    }
+    if (frame_tag(frame - LOG_TAG_SIZE, frame, head + body_len, tag) != STATUS_OK ||
+        secure_compare(tag, frame + head + body_len, LOG_TAG_SIZE) != STATUS_OK)
+    {
+        return 0;
+    }
+
+    int32_t delta = (int32_t) ((zz >> 1) ^ (0u - (zz & 1u)));
+
+    rec->timestamp   = cursor->timestamp + (uint32_t) delta;
+    rec->type        = frame[head + zz_len];
+    rec->payload_len = (uint8_t) (body_len - zz_len - 1);
+    memset(rec->payload, 0, sizeof(rec->payload));
+    memcpy(rec->payload, frame + head + zz_len + 1, rec->payload_len);
+
+    return head + body_len + LOG_TAG_SIZE;
+}
+
+// Next authentic frame of the page; bytes that do not decode are counted in
+// skipped. False once the written part of the page is used up.
+static bool
+cursor_next(log_cursor_t* cursor, log_record_t* rec)
+{
+    while (cursor->start < cursor->end)
+    {
+        const uint8_t* base  = cursor->page + cursor->start;
+        size_t         avail = cursor->end - cursor->start;
+
+        if (base[0] == 0)
+        {
+            // Padding: nothing more was written to this page
+            cursor->end = cursor->start;
+            break;
+        }
+
+        const uint8_t* sync = memchr(base, LOG_SYNC_BYTE, avail);
+        if (sync != base)
+        {
+            size_t gap = sync ? (size_t) (sync - base) : avail;
+            cursor->start += gap;
+            cursor->skipped += gap;
+            continue;
+        }
+
+        size_t frame_len = cursor_decode(cursor, avail, rec);
+        if (frame_len > 0)
+        {
+            cursor->start += frame_len;
+            cursor->timestamp = rec->timestamp;
+            memcpy(cursor->last, base + frame_len - LOG_TAG_SIZE, LOG_TAG_SIZE);
+            return true;
+        }
+
+        cursor->start += 1;
+        cursor->skipped += 1;
+    }
+
+    return false;
+}
+
+// Read the whole page in slot with one call and position the reader at its
+// first frame. Anything but a valid page leaves nothing to decode.
+static log_page_state_t
+reader_load_page(log_reader_t* reader, uint32_t slot, log_page_header_t* hdr)
+{
+    log_page_state_t state = LOG_PAGE_INVALID;
+
+    memset(&reader->cursor, 0, sizeof(reader->cursor));
+    reader->cursor.page = reader->page;
+
+    if (hal_storage_log_read(LOG_PAGE_OFFSET(slot), reader->page, sizeof(reader->page)) ==
+        STATUS_OK)
+    {
+        memcpy(hdr, reader->page, sizeof(*hdr));
+        state = page_header_check(slot, hdr);
+    }
+
+    if (state == LOG_PAGE_VALID)
+    {
+        reader->page_seq = hdr->seq;
+        cursor_open(&reader->cursor, reader->page, hdr);
+    }
+    else if (state == LOG_PAGE_INVALID)
+    {
+        reader->skipped += CONFIG_LOG_PAGE_SIZE;
+        reader->cursor.skipped = CONFIG_LOG_PAGE_SIZE;
+    }
+
+    return state;
+}
+
+static bool
+reader_next_page(log_reader_t* reader)
+{
+    while (reader->visited < reader->ring.pages)
+    {
+        log_page_header_t hdr;
+        uint32_t          slot = (reader->ring.oldest + reader->visited) % CONFIG_LOG_PAGE_COUNT;
+
+        reader->visited++;
+        if (reader_load_page(reader, slot, &hdr) == LOG_PAGE_VALID)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Next authentic frame; bytes that do not decode are counted in skipped
+static bool
+reader_next(log_reader_t* reader, log_record_t* rec)
+{
+    for (;;)
+    {
+        size_t skipped = reader->cursor.skipped;
+        bool   found   = cursor_next(&reader->cursor, rec);
+
+        reader->skipped += reader->cursor.skipped - skipped;
+        if (found)
+        {
+            return true;
+        }
+        if (!reader_next_page(reader))
+        {
+            return false;
+        }
+    }
+}
+
+// Verify one page from its first frame, or from a position inside it,
+// passing each authentic frame to callback if there is one
+static status_t
+page_verify(const uint8_t*        page,
+            uint32_t              slot,
+            const log_position_t* from,
+            log_query_cb_t        callback,
+            void*                 ctx,
+            log_page_summary_t*   out)
+{
+    log_page_header_t hdr;
+    log_cursor_t      cursor;
+    log_record_t      rec;
+
+    memset(out, 0, sizeof(*out));
+    memcpy(&hdr, page, sizeof(hdr));
+
+    switch (page_header_check(slot, &hdr))
+    {
+        case LOG_PAGE_BLANK:
+            return STATUS_OK;
+        case LOG_PAGE_INVALID:
+            return STATUS_ERR_TAMPER;
+        case LOG_PAGE_VALID:
+            break;
+    }
+
+    cursor_open(&cursor, page, &hdr);
+    if (from)
+    {
+        cursor.start     = from->used;
+        cursor.timestamp = from->timestamp;
+        memcpy(cursor.last, from->last, LOG_TAG_SIZE);
+    }
+
+    while (cursor_next(&cursor, &rec))
+    {
+        out->frames++;
+        if (callback && !callback(&rec, ctx))
+        {
+            break;
+        }
+    }
+
+    out->seq            = hdr.seq;
+    out->used           = (uint32_t) cursor.start;
+    out->skipped        = (uint32_t) cursor.skipped;
+    out->last_timestamp = cursor.timestamp;
+    memcpy(out->link, hdr.link, LOG_TAG_SIZE);
+    memcpy(out->last, cursor.last, LOG_TAG_SIZE);
+
+    return (cursor.skipped == 0) ? STATUS_OK : STATUS_ERR_TAMPER;
+}
+
+static void
+stats_note(uint32_t timestamp, uint8_t type)
+{
+    uint32_t slot = LOG_EVENT_SLOT(type);
+
+    log_stats.total++;
+    log_stats.count[slot]++;
+    log_stats.last_seen[slot] = timestamp;
+    log_stats.per_hour[(timestamp / 3600u) % LOG_STATS_HOURS]++;
+}
+
+static status_t
+checkpoint_compute_tag(const log_checkpoint_t* ckpt, uint8_t* out_tag)
+{
+    return compute_tag((const uint8_t*) ckpt, offsetof(log_checkpoint_t, tag), out_tag);
+}
+
+static bool
+checkpoint_authentic(const log_checkpoint_t* ckpt)
+{
+    uint8_t tag[LOG_TAG_SIZE];
+
+    return checkpoint_compute_tag(ckpt, tag) == STATUS_OK &&
+           secure_compare(tag, ckpt->tag, LOG_TAG_SIZE) == STATUS_OK && ckpt->pos.seq != 0 &&
+           ckpt->pos.used >= sizeof(log_page_header_t) && ckpt->pos.used <= CONFIG_LOG_PAGE_SIZE;
+}
+
+// Newer authentic checkpoint slot, if any
+static bool
+checkpoint_load(log_checkpoint_t* out)
+{
+    bool found = false;
+
+    for (uint32_t i = 0; i < LOG_CHECKPOINT_SLOTS; ++i)
+    {
+        log_checkpoint_t ckpt;
+
+        if (hal_storage_log_read(LOG_CHECKPOINT_OFFSET(i), (uint8_t*) &ckpt, sizeof(ckpt)) ==
+                STATUS_OK &&
+            checkpoint_authentic(&ckpt) && (!found || ckpt.generation > out->generation))
+        {
+            *out  = ckpt;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+// Record the on-disk append position; only valid with nothing buffered
+static status_t
+checkpoint_write(void)
+{
+    log_checkpoint_t ckpt   = {0};
+    status_t         status = STATUS_OK;
+
+    if (log_head_seq == 0 || log_buffered != 0 ||
+        (log_checkpoint_seq == log_head_seq && log_checkpoint_used == log_page_used))
+    {
+        return STATUS_OK;
+    }
+
+    ckpt.generation    = log_checkpoint_generation + 1;
+    ckpt.pos.seq       = log_head_seq;
+    ckpt.pos.used      = (uint32_t) log_page_used;
+    ckpt.pos.timestamp = log_last_timestamp;
+    memcpy(ckpt.pos.last, log_prev_tag, LOG_TAG_SIZE);
+    ckpt.stats = log_stats;
+
+    status = checkpoint_compute_tag(&ckpt, ckpt.tag);
+    if (status == STATUS_OK)
+    {
+        size_t slot = ckpt.generation % LOG_CHECKPOINT_SLOTS;
+
+        status = hal_storage_log_write(LOG_CHECKPOINT_OFFSET(slot), (const uint8_t*) &ckpt,
+                                       sizeof(ckpt));
+    }
+    if (status == STATUS_OK)
+    {
+        log_checkpoint_generation = ckpt.generation;
+        log_checkpoint_seq        = ckpt.pos.seq;
+        log_checkpoint_used       = ckpt.pos.used;
+    }
+
+    return status;
+}
+
+// Position the reader at pos, covering any pages opened since. False if the
+// page it points into has been overwritten.
+static bool
+reader_resume(log_reader_t* reader, const log_position_t* pos)
+{
+    log_page_header_t hdr;
+    uint32_t          slot = (pos->seq - 1) % CONFIG_LOG_PAGE_COUNT;
+
+    memset(reader, 0, sizeof(*reader));
+    if (reader_load_page(reader, slot, &hdr) != LOG_PAGE_VALID || hdr.seq != pos->seq)
+    {
+        return false;
+    }
+
+    reader->ring.oldest    = slot;
+    reader->ring.pages     = 1;
+    reader->ring.head_slot = slot;
+    reader->ring.head      = hdr;
+
+    while (reader->ring.pages < CONFIG_LOG_PAGE_COUNT)
+    {
+        log_page_header_t next;
+        uint32_t          next_slot = (reader->ring.head_slot + 1) % CONFIG_LOG_PAGE_COUNT;
+
+        if (page_header_read(next_slot, &next) != LOG_PAGE_VALID ||
+            next.seq != reader->ring.head.seq + 1)
+        {
+            break;
+        }
+        reader->ring.head_slot = next_slot;
+        reader->ring.head      = next;
+        reader->ring.pages++;
+    }
+
+    reader->visited          = 1;
+    reader->cursor.start     = pos->used;
+    reader->cursor.timestamp = pos->timestamp;
+    memcpy(reader->cursor.last, pos->last, LOG_TAG_SIZE);
+
+    return true;
+}
+
+#if CONFIG_LOG_SEGMENT_PAGES > 0
+
+static status_t
+seal_compute_tag(const log_segment_seal_t* seal, uint8_t* out_tag)
+{
+    return compute_tag((const uint8_t*) seal, offsetof(log_segment_seal_t, tag), out_tag);
+}
+
+// Account one page of a segment in its seal; a page that is not the
+// expected sequence number counts as skipped in full
+static void
+seal_note_page(log_segment_seal_t* seal, uint32_t i, const uint8_t* page)
+{
+    uint32_t           seq  = seal->first_seq + i;
+    log_page_summary_t summary;
+
+    page_verify(page, (seq - 1) % CONFIG_LOG_PAGE_COUNT, NULL, NULL, NULL, &summary);
+    if (summary.seq == seq)
+    {
+        seal->records += summary.frames;
+        seal->skipped += summary.skipped;
+        memcpy(seal->last, summary.last, LOG_TAG_SIZE);
+    }
+    else
+    {
+        seal->skipped += CONFIG_LOG_PAGE_SIZE;
+        memset(seal->last, 0, LOG_TAG_SIZE);
+    }
+    if (i == 0)
+    {
+        memcpy(seal->link, summary.link, LOG_TAG_SIZE);
+    }
+}
+
+// Copy the segment starting at first_seq out of the ring and seal it
+static status_t
+segment_seal(uint32_t first_seq)
+{
+    log_segment_seal_t seal   = {0};
+    status_t           status = STATUS_OK;
+    uint8_t            page[CONFIG_LOG_PAGE_SIZE];
+
+    seal.segment   = log_segment_number;
+    seal.first_seq = first_seq;
+    seal.pages     = CONFIG_LOG_SEGMENT_PAGES;
+
+    for (uint32_t i = 0; status == STATUS_OK && i < seal.pages; ++i)
+    {
+        uint32_t slot = (first_seq + i - 1) % CONFIG_LOG_PAGE_COUNT;
+
+        status = hal_storage_log_read(LOG_PAGE_OFFSET(slot), page, sizeof(page));
+        if (status == STATUS_OK)
+        {
+            seal_note_page(&seal, i, page);
+            status = hal_storage_segment_write(seal.segment, (size_t) i * CONFIG_LOG_PAGE_SIZE,
+                                               page, sizeof(page));
+        }
+    }
+
+    if (status == STATUS_OK)
+    {
+        status = seal_compute_tag(&seal, seal.tag);
+    }
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_segment_write(seal.segment,
+                                           (size_t) seal.pages * CONFIG_LOG_PAGE_SIZE,
+                                           (const uint8_t*) &seal, sizeof(seal));
+    }
+    // The index entry comes last: a segment counts as sealed once it is there
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_segment_index_write((size_t) seal.segment * sizeof(seal),
+                                                 (const uint8_t*) &seal, sizeof(seal));
+    }
+    if (status == STATUS_OK)
+    {
+        log_segment_number++;
+    }
+
+    return status;
+}
+
+// Seal every complete segment that starts before before_seq. One already
+// overwritten (archiving failed for a whole lap of the ring) is given up.
+static status_t
+segments_seal(uint32_t before_seq)
+{
+    status_t status = STATUS_OK;
+
+    while (status == STATUS_OK)
+    {
+        uint32_t first  = log_segment_seq;
+        uint32_t oldest = (log_head_seq > CONFIG_LOG_PAGE_COUNT)
+                              ? log_head_seq - CONFIG_LOG_PAGE_COUNT + 1
+                              : 1;
+
+        if (first + CONFIG_LOG_SEGMENT_PAGES > log_head_seq || first >= before_seq)
+        {
+            break; // Still being written, or not due yet
+        }
+        if (first >= oldest)
+        {
+            status = segment_seal(first);
+        }
+        if (status == STATUS_OK)
+        {
+            log_segment_seq += CONFIG_LOG_SEGMENT_PAGES;
+        }
+    }
+
+    return status;
+}
+
+// Pick up the archive numbering from the newest authentic seal in the index
+static void
+segments_locate(void)
+{
+    size_t             size  = 0;
+    bool               found = false;
+    log_segment_seal_t seal;
+    uint8_t            tag[LOG_TAG_SIZE];
+    uint32_t           oldest =
+        (log_head_seq > CONFIG_LOG_PAGE_COUNT) ? log_head_seq - CONFIG_LOG_PAGE_COUNT + 1 : 1;
+
+    if (hal_storage_segment_index_get_size(&size) == STATUS_OK)
+    {
+        for (size_t n = size / sizeof(seal); n > 0 && !found; --n)
+        {
+            found = hal_storage_segment_index_read((n - 1) * sizeof(seal), (uint8_t*) &seal,
+                                                   sizeof(seal)) == STATUS_OK &&
+                    seal_compute_tag(&seal, tag) == STATUS_OK &&
+                    secure_compare(tag, seal.tag, LOG_TAG_SIZE) == STATUS_OK &&
+                    seal.segment == n - 1;
+        }
+    }
+
+    log_segment_number = found ? seal.segment + 1 : 0;
+    log_segment_seq    = found ? seal.first_seq + seal.pages : 0;
+
+    // Nothing sealed from this ring yet (or the ring was started over):
+    // begin at the first segment boundary still in it
+    if (!found || log_segment_seq > log_head_seq + 1 || log_segment_seq < oldest)
+    {
+        log_segment_seq = ((oldest - 1 + CONFIG_LOG_SEGMENT_PAGES - 1) / CONFIG_LOG_SEGMENT_PAGES) *
+                              CONFIG_LOG_SEGMENT_PAGES +
+                          1;
+    }
+}
+
+// Check one indexed seal against its segment file. A removed file leaves
+// the seal alone to vouch for it.
+static status_t
+segment_check(const log_segment_seal_t* indexed)
+{
+    log_segment_seal_t stored;
+    log_segment_seal_t seal = {0};
+    uint8_t            page[CONFIG_LOG_PAGE_SIZE];
+    status_t           status =
+        hal_storage_segment_read(indexed->segment, (size_t) indexed->pages * CONFIG_LOG_PAGE_SIZE,
+                                 (uint8_t*) &stored, sizeof(stored));
+
+    if (status == STATUS_ERR_NOT_FOUND)
+    {
+        return STATUS_OK;
+    }
+    if (status == STATUS_OK && memcmp(&stored, indexed, sizeof(stored)) != 0)
+    {
+        status = STATUS_ERR_TAMPER;
+    }
+
+    seal.segment   = indexed->segment;
+    seal.first_seq = indexed->first_seq;
+    seal.pages     = indexed->pages;
+
+    for (uint32_t i = 0; status == STATUS_OK && i < seal.pages; ++i)
+    {
+        status = hal_storage_segment_read(seal.segment, (size_t) i * CONFIG_LOG_PAGE_SIZE, page,
+                                          sizeof(page));
+        if (status == STATUS_OK)
+        {
+            seal_note_page(&seal, i, page);
+        }
+    }
+
+    if (status == STATUS_OK && memcmp(&seal, indexed, offsetof(log_segment_seal_t, tag)) != 0)
+    {
+        status = STATUS_ERR_TAMPER;
+    }
+
+    return status;
+}
+
+#endif // CONFIG_LOG_SEGMENT_PAGES
+
+static status_t
+log_append(uint32_t now, uint8_t type, const uint8_t* payload, size_t payload_len);
+static status_t
+log_buffer_flush(void);
+
+static bool
+file_header_authentic(const log_file_header_t* hdr)
+{
+    uint8_t tag[LOG_TAG_SIZE];
+
+    return hdr->magic == LOG_MAGIC &&
+           compute_tag((const uint8_t*) hdr, offsetof(log_file_header_t, tag), tag) == STATUS_OK &&
+           secure_compare(tag, hdr->tag, LOG_TAG_SIZE) == STATUS_OK;
+}
+
+// Lay out an empty log file. The header goes first, so a format cut short
+// leaves a file of exactly the header that the next boot finishes.
+static status_t
+log_format(void)
+{
+    log_file_header_t hdr = {
+        .magic      = LOG_MAGIC,
+        .version    = LOG_FORMAT_VERSION,
+        .page_size  = CONFIG_LOG_PAGE_SIZE,
+        .page_count = CONFIG_LOG_PAGE_COUNT,
+    };
+    status_t status = compute_tag((const uint8_t*) &hdr, offsetof(log_file_header_t, tag), hdr.tag);
+
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_log_resize(0);
+    }
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_log_write(0, (const uint8_t*) &hdr, sizeof(hdr));
+    }
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_log_resize(LOG_FILE_SIZE);
+    }
+
+    return status;
+}
+
+// Decide what to do with the log file found at boot: open it, format a new
+// one, or set it aside (0 when kept, else a log_discard_reason_t)
+static status_t
+log_open_file(size_t size, uint8_t* out_discard)
+{
+    log_file_header_t hdr    = {0};
+    status_t          status = STATUS_OK;
+
+    *out_discard = 0;
+    if (size >= sizeof(hdr))
+    {
+        status = hal_storage_log_read(0, (uint8_t*) &hdr, sizeof(hdr));
+    }
+    if (status != STATUS_OK)
+    {
+        return status;
+    }
+
+    if (size == 0 || (size == sizeof(hdr) && file_header_authentic(&hdr) &&
+                      hdr.version == LOG_FORMAT_VERSION))
+    {
+        return log_format(); // New, or a format cut short: nothing to keep
+    }
+
+    if (!file_header_authentic(&hdr))
+    {
+        *out_discard = LOG_DISCARD_UNREADABLE;
+    }
+    else if (hdr.version != LOG_FORMAT_VERSION)
+    {
+        // Migrations from older versions go here; none is defined yet
+        *out_discard = LOG_DISCARD_VERSION;
+    }
+    else if (hdr.page_size != CONFIG_LOG_PAGE_SIZE || hdr.page_count != CONFIG_LOG_PAGE_COUNT ||
+             size != LOG_FILE_SIZE)
+    {
+        *out_discard = LOG_DISCARD_SIZE;
+    }
+
+    if (*out_discard != 0)
+    {
+        // Never overwrite what cannot be read: keep it for inspection. If an
+        // earlier discarded log is still there, refuse rather than lose one.
+        status = (hal_storage_log_retire() == STATUS_OK) ? log_format() : STATUS_ERR_TAMPER;
+    }
+
+    return status;
+}
+
+// Open the log file and find the append position in the newest page. With
+// a checkpoint only the frames after it are read and verified; without one
+// the whole ring is. A file that was set aside is recorded as the first
+// event of the new one.
+static status_t
+log_scan(void)
+{
+    size_t           size    = 0;
+    uint8_t          discard = 0;
+    log_checkpoint_t ckpt    = {0};
+    bool             resume  = false;
+    status_t         status  = hal_storage_log_get_size(&size);
+
+    if (status == STATUS_OK)
+    {
+        status = log_open_file(size, &discard);
+    }
+
+    if (status == STATUS_OK)
+    {
+        log_reader_t reader;
+        log_record_t rec;
+
+        resume = checkpoint_load(&ckpt) && reader_resume(&reader, &ckpt.pos);
+        if (!resume)
+        {
+            reader_open(&reader);
+        }
+
+        // Counters resume from the checkpoint, or are rebuilt from whatever
+        // the ring still holds
+        log_stats = resume ? ckpt.stats : (log_stats_t){0};
+        while (reader_next(&reader, &rec))
+        {
+            stats_note(rec.timestamp, rec.type);
+        }
+
+        // The cursor ends on the head page. A torn or damaged tail is left
+        // alone; writing resumes on a new page.
+        log_head_seq  = reader.ring.head.seq;
+        log_head_slot = reader.ring.head_slot;
+        log_page_used = (reader.cursor.skipped == 0) ? reader.cursor.start : CONFIG_LOG_PAGE_SIZE;
+        log_last_timestamp = reader.cursor.timestamp;
+        memcpy(log_prev_tag, reader.cursor.last, LOG_TAG_SIZE);
+
+        log_checkpoint_generation = resume ? ckpt.generation : 0;
+        log_checkpoint_seq        = resume ? ckpt.pos.seq : 0;
+        log_checkpoint_used       = resume ? ckpt.pos.used : 0;
+
+        log_buffered    = 0;
+        log_ready       = true;
+        log_index_ready = false;
+#if CONFIG_LOG_SEGMENT_PAGES > 0
+        segments_locate();
+#endif
+        status = checkpoint_write();
+    }
+
+    if (status == STATUS_OK && discard != 0)
+    {
+        uint8_t payload[5] = {discard, (uint8_t) size, (uint8_t) (size >> 8),
+                              (uint8_t) (size >> 16), (uint8_t) (size >> 24)};
+
+        status = log_append(hal_get_timestamp(), EVENT_LOG_DISCARDED, payload, sizeof(payload));
+        if (status == STATUS_OK)
+        {
+            status = log_buffer_flush();
+        }
+        if (status == STATUS_OK)
+        {
+            status = checkpoint_write();
+        }
+    }
+
+    return status;
+}
+
+// Start the next page, overwriting the oldest one once the ring is full
+static status_t
+log_page_open(uint32_t now)
+{
+    log_page_header_t hdr  = {.seq = log_head_seq + 1, .base_timestamp = now};
+    uint32_t          slot = (hdr.seq - 1) % CONFIG_LOG_PAGE_COUNT;
+    status_t          status;
+
+#if CONFIG_LOG_SEGMENT_PAGES > 0
+    // Archive what this page is about to overwrite. A failure must not stop
+    // the live log; log_step reports it and that segment is lost.
+    if (hdr.seq > CONFIG_LOG_PAGE_COUNT)
+    {
+        segments_seal(hdr.seq - CONFIG_LOG_PAGE_COUNT + 1);
+    }
+#endif
+
+    memcpy(hdr.link, log_prev_tag, LOG_TAG_SIZE);
+    status = compute_tag((const uint8_t*) &hdr, offsetof(log_page_header_t, tag), hdr.tag);
+
+    // Clear the page before its new header makes it current
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_log_write(LOG_PAGE_OFFSET(slot) + sizeof(hdr), log_blank_page,
+                                       sizeof(log_blank_page));
+    }
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_log_write(LOG_PAGE_OFFSET(slot), (const uint8_t*) &hdr, sizeof(hdr));
+    }
+    if (status == STATUS_OK)
+    {
+        log_head_seq       = hdr.seq;
+        log_head_slot      = slot;
+        log_page_used      = sizeof(hdr);
+        log_last_timestamp = now;
+        memcpy(log_prev_tag, hdr.tag, LOG_TAG_SIZE);
+        status = checkpoint_write();
+    }
+
+    return status;
+}
+
+static void
+index_note(uint32_t seq, uint32_t timestamp, uint8_t type)
+{
+    log_page_index_t* entry = &log_index[(seq - 1) % CONFIG_LOG_PAGE_COUNT];
+
+    if (entry->seq != seq)
+    {
+        entry->seq    = seq;
+        entry->min_ts = timestamp;
+        entry->max_ts = timestamp;
+        entry->types  = 0;
+        entry->status = STATUS_OK;
+    }
+    if (timestamp < entry->min_ts)
+    {
+        entry->min_ts = timestamp;
+    }
+    if (timestamp > entry->max_ts)
+    {
+        entry->max_ts = timestamp;
+    }
+    entry->types |= LOG_EVENT_BIT(type);
+}
+
+static void
+index_fault(uint32_t seq, status_t status)
+{
+    log_page_index_t* entry = &log_index[(seq - 1) % CONFIG_LOG_PAGE_COUNT];
+
+    if (entry->seq != seq)
+    {
+        memset(entry, 0, sizeof(*entry));
+        entry->seq = seq;
+    }
+    entry->status = status;
+}
+
+// One pass over every page the ring should still hold; log_append keeps the
+// index current afterwards. A page that is unreadable, replaced or partly
+// undecodable is remembered as such rather than as empty. Only valid with
+// nothing buffered.
+static void
+index_build(void)
+{
+    uint8_t  page[CONFIG_LOG_PAGE_SIZE];
+    uint32_t oldest =
+        (log_head_seq > CONFIG_LOG_PAGE_COUNT) ? log_head_seq - CONFIG_LOG_PAGE_COUNT + 1 : 1;
+
+    memset(log_index, 0, sizeof(log_index));
+    for (uint32_t seq = oldest; log_head_seq != 0 && seq <= log_head_seq; ++seq)
+    {
+        uint32_t          slot = (seq - 1) % CONFIG_LOG_PAGE_COUNT;
+        log_page_header_t hdr;
+        log_cursor_t      cursor;
+        log_record_t      rec;
+
+        if (hal_storage_log_read(LOG_PAGE_OFFSET(slot), page, sizeof(page)) != STATUS_OK)
+        {
+            index_fault(seq, STATUS_ERR_STORAGE);
+            continue;
+        }
+        memcpy(&hdr, page, sizeof(hdr));
+        if (page_header_check(slot, &hdr) != LOG_PAGE_VALID || hdr.seq != seq)
+        {
+            index_fault(seq, STATUS_ERR_TAMPER);
+            continue;
+        }
+
+        cursor_open(&cursor, page, &hdr);
+        while (cursor_next(&cursor, &rec))
+        {
+            index_note(seq, rec.timestamp, rec.type);
+        }
+        if (cursor.skipped != 0)
+        {
+            index_fault(seq, STATUS_ERR_TAMPER);
+        }
+    }
+    log_index_ready = true;
+}
+
+// Upkeep from log_step, with nothing buffered: seal the segments that are
+// complete and checkpoint the tail
+static status_t
+log_maintain(void)
+{
+    status_t status = STATUS_OK;
+
+#if CONFIG_LOG_SEGMENT_PAGES > 0
+    status = segments_seal(log_head_seq);
+#endif
+
+    status_t checkpoint_status = checkpoint_write();
+    if (status == STATUS_OK)
+    {
+        status = checkpoint_status;
+    }
+
+    return status;
+}
+
+// Append the buffered frames to the head page
+static status_t
+log_buffer_flush(void)
+{
+    status_t status = STATUS_OK;
+
+    if (log_buffered > 0)
+    {
+        status = hal_storage_log_write(LOG_PAGE_OFFSET(log_head_slot) + log_page_used, log_buffer,
+                                       log_buffered);
+    }
+    if (status == STATUS_OK)
+    {
+        log_page_used += log_buffered;
+        log_buffered = 0; // Kept on failure so the next flush retries them
+    }
+
+    return status;
+}
+
+// Encode one event into the buffer, opening a new page when it does not fit
+static status_t
+log_append(uint32_t now, uint8_t type, const uint8_t* payload, size_t payload_len)
+{
+    uint8_t  frame[LOG_FRAME_MAX];
+    size_t   len    = encode_frame(frame, now, type, payload, payload_len);
+    status_t status = STATUS_OK;
+
+    // Frames never straddle pages; a new page re-bases the timestamp delta
+    if (log_head_seq == 0 || log_page_used + log_buffered + len > CONFIG_LOG_PAGE_SIZE)
+    {
+        status = log_buffer_flush();
+        if (status == STATUS_OK)
+        {
+            status = log_page_open(now);
+        }
+        if (status == STATUS_OK)
+        {
+            len = encode_frame(frame, now, type, payload, payload_len);
+        }
+    }
+
+    if (status == STATUS_OK && len == 0)
+    {
+        status = STATUS_ERR_INTERNAL;
+    }
+
+    if (status == STATUS_OK && log_buffered + len > sizeof(log_buffer))
+    {
+        status = log_buffer_flush();
+    }
+
+    if (status == STATUS_OK)
+    {
+        memcpy(log_buffer + log_buffered, frame, len);
+        log_buffered += len;
+        log_last_timestamp = now;
+        memcpy(log_prev_tag, frame + len - LOG_TAG_SIZE, LOG_TAG_SIZE);
+        stats_note(now, type);
+        if (log_index_ready)
+        {
+            index_note(log_head_seq, now, type);
+        }
+    }
+
+    return status;
+}
+
+#if defined(CONFIG_LOG_ASYNC)
+
+// Wake the writer if it is parked. Callers publish their work first; the
+// writer sets log_writer_idle before re-checking for work, so one of the
+// two always sees the other.
+static void
+log_writer_wake(void)
+{
+    if (atomic_load(&log_writer_idle))
+    {
+        pthread_mutex_lock(&log_async_mutex);
+        pthread_cond_signal(&log_work_cond);
+        pthread_mutex_unlock(&log_async_mutex);
+    }
+}
+
+// Append every published event, then make the batch durable with one
+// flush. Returns the number of events taken off the queue.
+static uint32_t
+log_writer_drain(void)
+{
+    status_t status  = STATUS_OK;
+    uint32_t drained = 0;
+
+    LOG_STATE_LOCK();
+    for (;;)
+    {
+        log_queue_slot_t* slot = &log_queue[log_dequeue_pos & (CONFIG_LOG_QUEUE_DEPTH - 1)];
+        uint8_t           payload[LOG_MAX_PAYLOAD];
+
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != log_dequeue_pos + 1)
+        {
+            break; // Empty, or the next ticket's producer has not published yet
+        }
+
+        uint32_t timestamp   = slot->timestamp;
+        uint8_t  type        = slot->type;
+        uint8_t  payload_len = slot->payload_len;
+
+        memcpy(payload, slot->payload, payload_len);
+
+        // Hand the slot back before the slow part so producers can refill it
+        atomic_store_explicit(&slot->seq, log_dequeue_pos + CONFIG_LOG_QUEUE_DEPTH,
+                              memory_order_release);
+        log_dequeue_pos++;
+        drained++;
+
+        status_t append_status = log_append(timestamp, type, payload, payload_len);
+        if (status == STATUS_OK)
+        {
+            status = append_status;
+        }
+    }
+
+    status_t flush_status = log_buffer_flush();
+    if (status == STATUS_OK)
+    {
+        status = flush_status;
+    }
+    if (atomic_exchange(&log_maintain_requested, false) && status == STATUS_OK)
+    {
+        status = log_maintain();
+    }
+    LOG_STATE_UNLOCK();
+
+    pthread_mutex_lock(&log_async_mutex);
+    log_done_pos = log_dequeue_pos;
+    if (log_async_status == STATUS_OK)
+    {
+        log_async_status = status;
+    }
+    pthread_cond_broadcast(&log_progress_cond);
+    pthread_mutex_unlock(&log_async_mutex);
+
+    return drained;
+}
+
+static void*
+log_writer_main(void* arg)
+{
+    (void) arg;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&log_async_mutex);
+        atomic_store(&log_writer_idle, true);
+        while (!log_writer_stop && !atomic_load(&log_maintain_requested) &&
+               atomic_load(&log_enqueue_pos) == log_dequeue_pos)
+        {
+            pthread_cond_wait(&log_work_cond, &log_async_mutex);
+        }
+        atomic_store(&log_writer_idle, false);
+
+        bool stop = log_writer_stop && atomic_load(&log_enqueue_pos) == log_dequeue_pos;
+        pthread_mutex_unlock(&log_async_mutex);
+
+        if (stop)
+        {
+            break;
+        }
+        if (log_writer_drain() == 0)
+        {
+            sched_yield(); // A ticket is claimed but not yet published
+        }
+    }
+
+    return NULL;
+}
+
+// Copy one event into the queue. Blocks only while the queue is full, until
+// the writer has drained and flushed a batch.
+static status_t
+log_enqueue(uint32_t timestamp, uint8_t type, const uint8_t* payload, size_t payload_len)
+{
+    uint32_t          pos  = atomic_load_explicit(&log_enqueue_pos, memory_order_relaxed);
+    log_queue_slot_t* slot = NULL;
+
+    for (;;)
+    {
+        slot         = &log_queue[pos & (CONFIG_LOG_QUEUE_DEPTH - 1)];
+        int32_t diff = (int32_t) (atomic_load_explicit(&slot->seq, memory_order_acquire) - pos);
+
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak(&log_enqueue_pos, &pos, pos + 1))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            pthread_mutex_lock(&log_async_mutex);
+            pthread_cond_signal(&log_work_cond);
+            while ((int32_t) (atomic_load_explicit(&slot->seq, memory_order_acquire) - pos) < 0 &&
+                   atomic_load(&log_writer_running))
+            {
+                pthread_cond_wait(&log_progress_cond, &log_async_mutex);
+            }
+            pthread_mutex_unlock(&log_async_mutex);
+
+            if (!atomic_load(&log_writer_running))
+            {
+                return STATUS_ERR_UNINITIALIZED;
+            }
+            pos = atomic_load_explicit(&log_enqueue_pos, memory_order_relaxed);
+        }
+        else
+        {
+            pos = atomic_load_explicit(&log_enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    slot->timestamp   = timestamp;
+    slot->type        = type;
+    slot->payload_len = (uint8_t) payload_len;
+    if (payload_len > 0)
+    {
+        memcpy(slot->payload, payload, payload_len);
+    }
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+    log_writer_wake();
+
+    return STATUS_OK;
+}
+
+// Wait until every event queued before the call is appended and flushed;
+// returns the first writer error since the previous barrier
+static status_t
+log_writer_barrier(void)
+{
+    uint32_t target = atomic_load(&log_enqueue_pos);
+    status_t status = STATUS_OK;
+
+    pthread_mutex_lock(&log_async_mutex);
+    pthread_cond_signal(&log_work_cond);
+    while ((int32_t) (log_done_pos - target) < 0)
+    {
+        pthread_cond_wait(&log_progress_cond, &log_async_mutex);
+    }
+    status           = log_async_status;
+    log_async_status = STATUS_OK;
+    pthread_mutex_unlock(&log_async_mutex);
+
+    return status;
+}
+
+static void
+log_writer_start(void)
+{
+    atomic_store(&log_enqueue_pos, 0);
+    log_dequeue_pos  = 0;
+    log_done_pos     = 0;
+    log_async_status = STATUS_OK;
+    log_writer_stop  = false;
+    for (uint32_t i = 0; i < CONFIG_LOG_QUEUE_DEPTH; ++i)
+    {
+        atomic_store(&log_queue[i].seq, i);
+    }
+
+    // Without a thread the log keeps working inline, as in a synchronous build
+    if (pthread_create(&log_writer, NULL, log_writer_main, NULL) == 0)
+    {
+        atomic_store(&log_writer_running, true);
+    }
+}
+
+// The writer drains whatever is still queued before it exits
+static void
+log_writer_join(void)
+{
+    pthread_mutex_lock(&log_async_mutex);
+    log_writer_stop = true;
+    pthread_cond_signal(&log_work_cond);
+    pthread_mutex_unlock(&log_async_mutex);
+
+    pthread_join(log_writer, NULL);
+    atomic_store(&log_writer_running, false);
+}
+
+#endif // CONFIG_LOG_ASYNC
+
+// Scan the log if that has not happened yet and start the writer thread
+static status_t
+log_start(void)
 {
-    FILE* file;
-};
+    status_t status = STATUS_OK;
 
-static void
-compute_hmac(log_record_t* record)
+    LOG_STATE_LOCK();
+    if (!log_ready)
+    {
+        status = log_scan();
+    }
+    LOG_STATE_UNLOCK();
+
+#if defined(CONFIG_LOG_ASYNC)
+    if (status == STATUS_OK && !atomic_load(&log_writer_running))
+    {
+        log_writer_start();
+    }
+#endif
+
+    return status;
+}
+
+status_t
+log_init(void)
 {
-    memset(record->hmac, 0, sizeof(record->hmac));
-    compute_internal_hmac((uint8_t*) record, sizeof(log_record_t) - sizeof(record->hmac),
-                          record->hmac, sizeof(record->hmac));
+#if defined(CONFIG_LOG_ASYNC)
+    if (atomic_load(&log_writer_running))
+    {
+        log_writer_barrier();
+        log_writer_join();
+    }
+#endif
+
+    log_ready = false;
+
+    return log_start();
 }
 
-static bool
-validate_hmac(const log_record_t* record)
+status_t
+log_write(log_event_t type, const uint8_t* payload, size_t payload_len)
 {
-    log_record_t temp = *record;
-    memset(temp.hmac, 0, sizeof(temp.hmac));
-    uint8_t temp_mac[LOG_HMAC_SIZE];
+    if ((payload_len > 0 && !payload) || payload_len > LOG_MAX_PAYLOAD)
+    {
+        return STATUS_ERR_INPUT;
+    }
+
+    uint32_t now    = hal_get_timestamp();
+    status_t status = STATUS_OK;
 
-    if (compute_internal_hmac((uint8_t*) &temp, sizeof(log_record_t) - sizeof(temp.hmac), temp_mac,
-                              sizeof(temp_mac)) != STATUS_OK)
+#if defined(CONFIG_LOG_ASYNC)
+    if (!atomic_load(&log_writer_running))
     {
-        return false;
+        status = log_start();
+    }
+    if (status == STATUS_OK && atomic_load(&log_writer_running))
+    {
+        status = log_enqueue(now, (uint8_t) type, payload, payload_len);
+        if (status == STATUS_OK && CONFIG_LOG_FLUSH_MODE == LOG_FLUSH_IMMEDIATE)
+        {
+            status = log_writer_barrier();
+        }
+        return status;
+    }
+#endif
+
+    LOG_STATE_LOCK();
+    if (status == STATUS_OK && !log_ready)
+    {
+        status = log_scan();
     }
+    if (status == STATUS_OK)
+    {
+        status = log_append(now, (uint8_t) type, payload, payload_len);
+    }
+    if (status == STATUS_OK && CONFIG_LOG_FLUSH_MODE == LOG_FLUSH_IMMEDIATE)
+    {
+        status = log_buffer_flush();
+    }
+    LOG_STATE_UNLOCK();
 
-    return secure_compare(record->hmac, temp_mac, sizeof(temp_mac)) == STATUS_OK;
+    return status;
 }
 
 status_t
-log_init(void)
+log_flush(void)
 {
-    log_stream_t stream;
-    log_record_t rec;
-    size_t       log_size = 0;
-    status_t     status   = STATUS_OK;
+#if defined(CONFIG_LOG_ASYNC)
+    if (atomic_load(&log_writer_running))
+    {
+        return log_writer_barrier();
+    }
+#endif
+
+    LOG_STATE_LOCK();
+    status_t status = log_buffer_flush();
+    LOG_STATE_UNLOCK();
+
+    return status;
+}
+
+status_t
+log_commit(void)
+{
+    status_t status = STATUS_OK;
+
+#if defined(CONFIG_LOG_ASYNC)
+    if (atomic_load(&log_writer_running))
+    {
+        // The writer flushes every batch it drains; nothing to wait for
+        return status;
+    }
+#endif
+
+    if (CONFIG_LOG_FLUSH_MODE != LOG_FLUSH_TICK)
+    {
+        status = log_flush();
+    }
+
+    return status;
+}
+
+status_t
+log_step(void)
+{
+#if defined(CONFIG_LOG_ASYNC)
+    if (atomic_load(&log_writer_running))
+    {
+        atomic_store(&log_maintain_requested, true);
+        return log_writer_barrier();
+    }
+#endif
+
+    LOG_STATE_LOCK();
+    status_t status = log_buffer_flush();
+
+    if (status == STATUS_OK)
+    {
+        status = log_maintain();
+    }
+    LOG_STATE_UNLOCK();
+
+    return status;
+}
+
+status_t
+log_shutdown(void)
+{
+    status_t status = STATUS_OK;
+
+#if defined(CONFIG_LOG_ASYNC)
+    if (atomic_load(&log_writer_running))
+    {
+        status = log_writer_barrier();
+        log_writer_join();
+    }
+#endif
+
+    status_t step_status = log_step();
+    if (status == STATUS_OK)
+    {
+        status = step_status;
+    }
+
+    return status;
+}
+
+status_t
+log_verify_page(const uint8_t* page, uint32_t slot, log_page_summary_t* out)
+{
+    if (!page || !out || slot >= CONFIG_LOG_PAGE_COUNT)
+    {
+        return STATUS_ERR_INPUT;
+    }
+
+    return page_verify(page, slot, NULL, NULL, NULL, out);
+}
+
+status_t
+log_decode_page(const uint8_t*      page,
+                uint32_t            slot,
+                log_query_cb_t      callback,
+                void*               ctx,
+                log_page_summary_t* out)
+{
+    if (!page || !callback || !out || slot >= CONFIG_LOG_PAGE_COUNT)
+    {
+        return STATUS_ERR_INPUT;
+    }
+
+    return page_verify(page, slot, NULL, callback, ctx, out);
+}
+
+size_t
+log_page_offset(uint32_t slot)
+{
+    return LOG_PAGE_OFFSET(slot);
+}
 
-    status = hal_storage_log_get_size(&log_size);
-    if ((STATUS_OK == status) && (log_size > LOG_MAX_SIZE_BYTES))
+uint32_t
+log_file_head_seq(const uint8_t* file, size_t len)
+{
+    log_checkpoint_t ckpt;
+    uint32_t         generation = 0;
+    uint32_t         seq        = 0;
+
+    for (uint32_t i = 0; file && i < LOG_CHECKPOINT_SLOTS; ++i)
     {
-        status = STATUS_ERR_LOG_FULL;
+        if (LOG_CHECKPOINT_OFFSET(i) + sizeof(ckpt) > len)
+        {
+            break;
+        }
+        memcpy(&ckpt, file + LOG_CHECKPOINT_OFFSET(i), sizeof(ckpt));
+        if (checkpoint_authentic(&ckpt) && (seq == 0 || ckpt.generation > generation))
+        {
+            generation = ckpt.generation;
+            seq        = ckpt.pos.seq;
+        }
     }
 
-    if (STATUS_OK == status)
+    return seq;
+}
+
+// Check the ring from log_verified (or the oldest page) up to the head
+static status_t
+ring_verify(void)
+{
+    status_t status = STATUS_OK;
+
+    // Pick up where the last call stopped unless that page has since been
+    // overwritten; the oldest page has no predecessor left to link to.
+    uint32_t oldest =
+        (log_head_seq > CONFIG_LOG_PAGE_COUNT) ? log_head_seq - CONFIG_LOG_PAGE_COUNT + 1 : 1;
+    bool     resume = log_verified.seq >= oldest && log_verified.seq <= log_head_seq;
+    uint32_t first  = resume ? log_verified.seq : oldest;
+    uint8_t  page[CONFIG_LOG_PAGE_SIZE];
+    uint8_t  last[LOG_TAG_SIZE];
+
+    log_page_summary_t summary = {0};
+
+    memcpy(last, log_verified.last, LOG_TAG_SIZE);
+
+    for (uint32_t seq = first; status == STATUS_OK && seq <= log_head_seq; ++seq)
     {
-        if (!hal_log_stream_open(&stream))
+        uint32_t slot = (seq - 1) % CONFIG_LOG_PAGE_COUNT;
+
+        status = hal_storage_log_read(LOG_PAGE_OFFSET(slot), page, sizeof(page));
+        if (status == STATUS_OK)
         {
-            status = STATUS_ERR_STORAGE;
+            status = page_verify(page, slot, (resume && seq == first) ? &log_verified : NULL,
+                                 NULL, NULL, &summary);
         }
-        else
+        if (status == STATUS_OK &&
+            (summary.seq != seq ||
+             (seq != first && secure_compare(summary.link, last, LOG_TAG_SIZE) != STATUS_OK)))
+        {
+            status = STATUS_ERR_TAMPER;
+        }
+        memcpy(last, summary.last, LOG_TAG_SIZE);
+    }
+
+    if (status == STATUS_OK)
+    {
+        log_verified.seq       = log_head_seq;
+        log_verified.used      = summary.used;
+        log_verified.timestamp = summary.last_timestamp;
+        memcpy(log_verified.last, summary.last, LOG_TAG_SIZE);
+    }
+
+    return status;
+}
+
+status_t
+log_verify(void)
+{
+    status_t          status = log_start();
+    log_file_header_t hdr;
+
+    if (status == STATUS_OK)
+    {
+        status = log_flush();
+    }
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_log_read(0, (uint8_t*) &hdr, sizeof(hdr));
+    }
+    if (status == STATUS_OK &&
+        (!file_header_authentic(&hdr) || hdr.version != LOG_FORMAT_VERSION))
+    {
+        status = STATUS_ERR_TAMPER;
+    }
+    if (status == STATUS_OK)
+    {
+        LOG_STATE_LOCK();
+        if (log_head_seq != 0)
+        {
+            status = ring_verify();
+        }
+        LOG_STATE_UNLOCK();
+    }
+
+    return status;
+}
+
+// Decode one indexed page and report its matching frames; *more turns false
+// once the callback asks to stop. A page that no longer reads back as the one
+// indexed, or holds bytes that do not decode, may have hidden matches.
+static status_t
+query_page(uint32_t seq, uint32_t from_ts, uint32_t to_ts, uint32_t type_mask,
+           log_query_cb_t callback, void* ctx, bool* more)
+{
+    uint8_t           page[CONFIG_LOG_PAGE_SIZE];
+    uint32_t          slot = (seq - 1) % CONFIG_LOG_PAGE_COUNT;
+    log_page_header_t hdr;
+    log_cursor_t      cursor;
+    log_record_t      rec;
+
+    if (hal_storage_log_read(LOG_PAGE_OFFSET(slot), page, sizeof(page)) != STATUS_OK)
+    {
+        return STATUS_ERR_STORAGE;
+    }
+
+    memcpy(&hdr, page, sizeof(hdr));
+    if (page_header_check(slot, &hdr) != LOG_PAGE_VALID || hdr.seq != seq)
+    {
+        return STATUS_ERR_TAMPER;
+    }
+
+    cursor_open(&cursor, page, &hdr);
+    while (cursor_next(&cursor, &rec))
+    {
+        if (rec.timestamp >= from_ts && rec.timestamp <= to_ts &&
+            (type_mask & LOG_EVENT_BIT(rec.type)) != 0 && !callback(&rec, ctx))
+        {
+            *more = false;
+            return STATUS_OK;
+        }
+    }
+
+    return (cursor.skipped == 0) ? STATUS_OK : STATUS_ERR_TAMPER;
+}
+
+status_t
+log_query(uint32_t from_ts, uint32_t to_ts, uint32_t type_mask, log_query_cb_t callback,
+          void* ctx)
+{
+    if (!callback || from_ts > to_ts)
+    {
+        return STATUS_ERR_INPUT;
+    }
+
+    status_t status = log_start();
+
+    if (status == STATUS_OK)
+    {
+        status = log_flush();
+    }
+    if (status != STATUS_OK)
+    {
+        return status;
+    }
+
+    LOG_STATE_LOCK();
+    if (!log_index_ready)
+    {
+        index_build();
+    }
+
+    uint32_t oldest =
+        (log_head_seq > CONFIG_LOG_PAGE_COUNT) ? log_head_seq - CONFIG_LOG_PAGE_COUNT + 1 : 1;
+    bool more = true;
+
+    for (uint32_t seq = oldest; more && log_head_seq != 0 && seq <= log_head_seq; ++seq)
+    {
+        const log_page_index_t* entry = &log_index[(seq - 1) % CONFIG_LOG_PAGE_COUNT];
+
+        // Whatever it held is unknown, so it may have matched
+        if (entry->seq == seq && entry->status != STATUS_OK && status == STATUS_OK)
+        {
+            status = entry->status;
+        }
+
+        // Pages outside the range or without a wanted type are never read
+        if (entry->seq == seq && entry->max_ts >= from_ts && entry->min_ts <= to_ts &&
+            (entry->types & type_mask) != 0)
         {
-            while (hal_log_stream_next(&stream, &rec))
+            // Later pages are still reported; the first failure is returned
+            status_t page_status = query_page(seq, from_ts, to_ts, type_mask, callback, ctx, &more);
+            if (status == STATUS_OK)
             {
-                // pass
+                status = page_status;
             }
-            hal_log_stream_close(&stream);
         }
     }
+    LOG_STATE_UNLOCK();
 
     return status;
 }
 
 status_t
-log_write(log_event_t type, const uint8_t* payload, size_t payload_len)
+log_verify_segments(void)
 {
-    if ((payload_len > 0 && !payload) || payload_len > LOG_MAX_PAYLOAD)
+    status_t status = log_start();
+
+#if CONFIG_LOG_SEGMENT_PAGES > 0
+    size_t size = 0;
+
+    LOG_STATE_LOCK();
+    if (status == STATUS_OK)
+    {
+        status = hal_storage_segment_index_get_size(&size);
+    }
+
+    // Seals past log_segment_number are leftovers from a torn index write
+    size_t end = (size_t) log_segment_number * sizeof(log_segment_seal_t);
+    if (size < end)
+    {
+        end = size;
+    }
+
+    for (size_t off = (size_t) log_segments_checked * sizeof(log_segment_seal_t);
+         status == STATUS_OK && off + sizeof(log_segment_seal_t) <= end;
+         off += sizeof(log_segment_seal_t))
+    {
+        log_segment_seal_t seal;
+        uint8_t            tag[LOG_TAG_SIZE];
+
+        status = hal_storage_segment_index_read(off, (uint8_t*) &seal, sizeof(seal));
+        if (status == STATUS_OK &&
+            (seal_compute_tag(&seal, tag) != STATUS_OK ||
+             secure_compare(tag, seal.tag, LOG_TAG_SIZE) != STATUS_OK ||
+             seal.segment != log_segments_checked || seal.pages == 0 ||
+             seal.pages > CONFIG_LOG_PAGE_COUNT))
+        {
+            status = STATUS_ERR_TAMPER;
+        }
+        // Adjacent segments of the same ring must chain
+        if (status == STATUS_OK && log_segments_prev.pages != 0 &&
+            seal.first_seq == log_segments_prev.first_seq + log_segments_prev.pages &&
+            secure_compare(seal.link, log_segments_prev.last, LOG_TAG_SIZE) != STATUS_OK)
+        {
+            status = STATUS_ERR_TAMPER;
+        }
+        if (status == STATUS_OK)
+        {
+            status = segment_check(&seal);
+        }
+        if (status == STATUS_OK)
+        {
+            log_segments_prev = seal;
+            log_segments_checked++;
+        }
+    }
+    LOG_STATE_UNLOCK();
+#endif
+
+    return status;
+}
+
+status_t
+log_segment_seal_check(const uint8_t* seal, size_t len, log_segment_info_t* out)
+{
+    if (!seal || !out)
     {
         return STATUS_ERR_INPUT;
     }
-    const uint8_t sync_start_byte = 0xA5;
-    log_record_t  rec             = {
-                     .sync_byte   = sync_start_byte,
-                     .data_length = sizeof(uint32_t) + sizeof(uint8_t) + payload_len,
-                     .timestamp   = hal_get_timestamp(),
-                     .type        = type,
-    };
 
-    memcpy_s(rec.payload, LOG_MAX_PAYLOAD, payload, payload_len);
-    compute_hmac(&rec);
+#if CONFIG_LOG_SEGMENT_PAGES > 0
+    log_segment_seal_t stored;
+    uint8_t            tag[LOG_TAG_SIZE];
+
+    if (len != sizeof(stored))
+    {
+        return STATUS_ERR_TAMPER;
+    }
+
+    memcpy(&stored, seal, sizeof(stored));
+    if (seal_compute_tag(&stored, tag) != STATUS_OK ||
+        secure_compare(tag, stored.tag, LOG_TAG_SIZE) != STATUS_OK || stored.pages == 0 ||
+        stored.pages > CONFIG_LOG_PAGE_COUNT || stored.first_seq == 0)
+    {
+        return STATUS_ERR_TAMPER;
+    }
+
+    out->segment   = stored.segment;
+    out->first_seq = stored.first_seq;
+    out->pages     = stored.pages;
+    out->records   = stored.records;
+    out->skipped   = stored.skipped;
+
+    return STATUS_OK;
+#else
+    (void) len;
+    return STATUS_ERR_NOT_FOUND;
+#endif
+}
+
+status_t
+log_remove_segment(uint32_t segment)
+{
+    status_t status = log_start();
+
+#if CONFIG_LOG_SEGMENT_PAGES > 0
+    LOG_STATE_LOCK();
+    if (status == STATUS_OK)
+    {
+        status = (segment < log_segment_number) ? hal_storage_segment_remove(segment)
+                                                : STATUS_ERR_INPUT;
+    }
+    LOG_STATE_UNLOCK();
+#else
+    (void) segment;
+    if (status == STATUS_OK)
+    {
+        status = STATUS_ERR_NOT_FOUND;
+    }
+#endif
+
+    return status;
+}
+
+status_t
+log_get_stats(log_stats_t* out)
+{
+    if (!out)
+    {
+        return STATUS_ERR_INPUT;
+    }
 
-    return hal_storage_log_append((const uint8_t*) &rec, sizeof(rec));
+    status_t status = log_start();
+
+    if (status == STATUS_OK)
+    {
+        LOG_STATE_LOCK();
+        *out = log_stats;
+        LOG_STATE_UNLOCK();
+    }
+
+    return status;
 }
 
 void
@@ -99,45 +2174,30 @@ log_dump(void)
 {
     printf("=== LOG DUMP BEGIN ===\n");
 
-    log_stream_t stream;
-    if (!hal_log_stream_open(&stream))
-    {
-        printf("Failed to open log stream.\n");
-        return;
-    }
+    log_flush();
+    LOG_STATE_LOCK();
+
+    log_reader_t reader;
+    reader_open(&reader);
 
     log_record_t rec;
     unsigned     index = 0;
 
-    while (hal_log_stream_next(&stream, &rec))
+    while (reader_next(&reader, &rec))
     {
-        bool valid = validate_hmac(&rec);
+        if (reader.skipped > 0)
+        {
+            printf("Skipped %zu unauthentic bytes\n", reader.skipped);
+            reader.skipped = 0;
+        }
 
         printf("Entry %u:\n", index);
-        printf("  HMAC   : %s\n", valid ? "VALID" : "INVALID");
         printf("  Time   : %" PRIu32 "\n", rec.timestamp);
         printf("  Type   : %u\n", rec.type);
-        printf("  Length : %u\n", rec.data_length);
+        printf("  Length : %u\n", rec.payload_len);
         printf("  Payload: ");
 
-        size_t payload_len = 0;
-        size_t header_size = sizeof(rec.timestamp) + sizeof(rec.type);
-
-        if (rec.data_length > header_size)
-        {
-            payload_len = rec.data_length - header_size;
-        }
-        else
-        {
-            payload_len = 0;
-        }
-
-        if (payload_len > LOG_MAX_PAYLOAD)
-        {
-            payload_len = LOG_MAX_PAYLOAD;
-        }
-
-        for (size_t i = 0; i < payload_len; ++i)
+        for (size_t i = 0; i < rec.payload_len; ++i)
         {
             printf("%02X ", rec.payload[i]);
         }
@@ -147,6 +2207,11 @@ log_dump(void)
         index++;
     }
 
-    hal_log_stream_close(&stream);
+    if (reader.skipped > 0)
+    {
+        printf("Skipped %zu unauthentic bytes\n", reader.skipped);
+    }
+
+    LOG_STATE_UNLOCK();
     printf("=== LOG DUMP END ===\n");
 }
@@ -18,19 +18,53 @@ typedef enum
     EVENT_REQUEST_PASS_CHANGE = 6,
     EVENT_PASS_CHANGE_FAILED  = 7,
     EVENT_PASS_CHANGE_PASSED  = 8,
+    EVENT_LOG_DISCARDED       = 9, // Payload: log_discard_reason_t, then the file size (u32 LE)
 } log_event_t;
 
-// --- Log record structure ---
+// Why log_init set the previous log file aside as LOG_RETIRED_FILENAME
+typedef enum
+{
+    LOG_DISCARD_UNREADABLE = 1, // No authentic file header
+    LOG_DISCARD_VERSION    = 2, // A format version with no migration
+    LOG_DISCARD_SIZE       = 3, // Ring geometry or file size does not match
+} log_discard_reason_t;
+
+// --- Decoded log record (see logging.c for the on-disk frame) ---
 struct log_record_t
 {
-    uint8_t  sync_byte;                // Always 0xA5
-    uint16_t data_length;              // timestamp + type + payload
     uint32_t timestamp;                // Event time
     uint8_t  type;                     // Event type (log_event_t or custom)
+    uint8_t  payload_len;              // Bytes used in payload
     uint8_t  payload[LOG_MAX_PAYLOAD]; // Variable content
-    uint8_t  hmac[LOG_HMAC_SIZE];      // Integrity check
-} __attribute__((packed));
+};
 
+// Frames are buffered in RAM and appended to storage in one durable write
+// per flush. The buffer is always flushed when it is full, by log_flush(),
+// by log_step() and before the lock is actuated. Beyond that,
+// CONFIG_LOG_FLUSH_MODE selects:
+//
+//   LOG_FLUSH_IMMEDIATE    Every record is durable when log_write returns.
+//   LOG_FLUSH_TRANSACTION  Records are durable when the locksys call that
+//                          emitted them returns (log_commit). A crash inside
+//                          that call can lose its records.
+//   LOG_FLUSH_TICK         Records are durable after the next locksys_step.
+//                          A crash can lose everything logged since the
+//                          last step or buffer-full flush.
+//
+// With CONFIG_LOG_ASYNC, log_write copies the event into a queue and a
+// writer thread encodes, MACs and flushes it in batches, so callers do no
+// log I/O. A record is then durable once the writer has drained it, usually
+// right away; log_commit does not wait for that, and neither does the
+// unlock path before actuating the lock. log_flush, log_step and
+// log_shutdown are barriers: they return once everything queued before the
+// call is on storage. LOG_FLUSH_IMMEDIATE makes every log_write a barrier.
+
+// Resumes after the last checkpoint, verifying only the records appended
+// since; without an authentic checkpoint the whole ring is scanned. Only a
+// missing or empty log file is formatted silently. Any other file that
+// cannot be opened as is gets set aside and an EVENT_LOG_DISCARDED starts
+// the new log, or STATUS_ERR_TAMPER is returned if a set-aside log is
+// already there.
 status_t
 log_init(void);
 
@@ -38,8 +72,147 @@ log_init(void);
 status_t
 log_write(log_event_t type, const uint8_t* payload, size_t payload_len);
 
+// Append all buffered records to storage
+status_t
+log_flush(void);
+
+// End of a logical operation: flushes unless CONFIG_LOG_FLUSH_MODE is LOG_FLUSH_TICK
+status_t
+log_commit(void);
+
+// Periodic hook, called from locksys_step: flushes and checkpoints the tail
+status_t
+log_step(void);
+
+// Makes everything logged so far durable, checkpoints the tail and stops
+// the writer thread. Call once no other thread is logging; a later
+// log_write starts the writer again.
+status_t
+log_shutdown(void);
+
 typedef struct log_record_t log_record_t;
 
+#define LOG_STATS_TYPES 32 // One slot per LOG_EVENT_SLOT
+#define LOG_STATS_HOURS 24
+
+// Running totals over every record written, including records the ring
+// has since overwritten. Saved with each checkpoint, so boot restores them
+// and only counts the records appended after it.
+typedef struct
+{
+    uint32_t total;
+    uint32_t count[LOG_STATS_TYPES];     // Records per LOG_EVENT_SLOT
+    uint32_t last_seen[LOG_STATS_TYPES]; // Timestamp of the latest record (0 = none)
+    uint32_t per_hour[LOG_STATS_HOURS];  // Records per hour of day (UTC), all types
+} log_stats_t;
+
+// Outcome of checking one stored page on its own (see log_verify_page)
+typedef struct
+{
+    uint32_t seq;                // Page sequence number, 0 for a blank page
+    uint32_t used;               // Bytes up to the end of the last frame, header included
+    uint32_t frames;             // Authentic frames
+    uint32_t skipped;            // Bytes that did not authenticate
+    uint32_t last_timestamp;     // Of the last authentic frame, or the page base
+    uint8_t  link[LOG_TAG_SIZE]; // Last tag of the previous page, from the header
+    uint8_t  last[LOG_TAG_SIZE]; // Tag the next page must link to
+} log_page_summary_t;
+
+// Checks the header and every frame of one CONFIG_LOG_PAGE_SIZE page read
+// from ring slot. It touches no log state, so once log_init has run a
+// verifier can check pages on several threads and then compare each page's
+// link with its predecessor's last tag. STATUS_ERR_TAMPER if anything in the
+// page does not authenticate; a blank page is STATUS_OK with seq 0.
+status_t
+log_verify_page(const uint8_t* page, uint32_t slot, log_page_summary_t* out);
+
+// Checks the stored ring: every frame, the chain inside each page and the
+// links between pages. Resumes where the previous successful call stopped,
+// so periodic calls only read what was appended since. STATUS_ERR_TAMPER on
+// any break. Pages are checked one after another on the calling thread; to
+// check a whole file in parallel, a caller runs log_verify_page (or
+// log_decode_page) on its own threads and chains the summaries itself, as
+// tools/export_log.c does.
+status_t
+log_verify(void);
+
+// Type mask bit for an event type; types from 31 up share the top bit
+#define LOG_EVENT_SLOT(type) (((uint32_t) (type) < 31u) ? (uint32_t) (type) : 31u)
+#define LOG_EVENT_BIT(type) (1u << LOG_EVENT_SLOT(type))
+#define LOG_QUERY_ALL_TYPES 0xFFFFFFFFu
+
+// Receives each matching record, oldest first; return false to stop
+typedef bool (*log_query_cb_t)(const log_record_t* rec, void* ctx);
+
+// Streams the authentic records with from_ts <= timestamp <= to_ts whose
+// LOG_EVENT_BIT is in type_mask. An in-RAM index of each page's time span
+// and event types, built by one pass on the first query and kept current by
+// log_write, means only pages that can match are read. The callback runs
+// with the log locked and must not call back into the log. A page that
+// cannot be read (STATUS_ERR_STORAGE) or no longer authenticates
+// (STATUS_ERR_TAMPER) may have held matches: the remaining pages are still
+// reported, then the first such error is returned, so a partial answer
+// never looks complete.
+status_t
+log_query(uint32_t from_ts, uint32_t to_ts, uint32_t type_mask, log_query_cb_t callback,
+          void* ctx);
+
+// log_verify_page that also hands each authentic frame of the page to
+// callback, in order. Like it, safe to run on several threads at once once
+// the device key has been used (any MAC computed) on one thread.
+status_t
+log_decode_page(const uint8_t*      page,
+                uint32_t            slot,
+                log_query_cb_t      callback,
+                void*               ctx,
+                log_page_summary_t* out);
+
+// Byte offset of ring slot in LOG_STORAGE_FILENAME; a segment file holds
+// its pages from offset 0
+size_t
+log_page_offset(uint32_t slot);
+
+// Page the newest authentic checkpoint in a copy of LOG_STORAGE_FILENAME
+// points into, 0 if there is none. Every page up to it has been written,
+// so a reader can tell a missing head page from the end of the log.
+uint32_t
+log_file_head_seq(const uint8_t* file, size_t len);
+
+// What a segment seal records about its segment
+typedef struct
+{
+    uint32_t segment;   // Archive number
+    uint32_t first_seq; // Page sequence of its first page
+    uint32_t pages;
+    uint32_t records; // Authentic frames when sealed
+    uint32_t skipped; // Bytes that did not authenticate when sealed
+} log_segment_info_t;
+
+// Authenticates a seal: the bytes of a segment file after its pages.
+// STATUS_ERR_TAMPER if it does not check out, STATUS_ERR_NOT_FOUND when
+// segments are disabled.
+status_t
+log_segment_seal_check(const uint8_t* seal, size_t len, log_segment_info_t* out);
+
+// Checks the sealed segments listed in the archive index, in order: each
+// seal's MAC and numbering, the chain between adjacent segments, and the
+// segment file's pages against its seal. Segments that passed are skipped
+// by later calls; a removed segment file leaves only its seal to check.
+// STATUS_ERR_TAMPER on any mismatch.
+status_t
+log_verify_segments(void);
+
+// Deletes the file of a sealed segment (numbered from 0 in sealing order),
+// for instance once it has been archived elsewhere. Its seal stays in the
+// index and no live data is rewritten.
+status_t
+log_remove_segment(uint32_t segment);
+
+// Copies the counters; records still queued for the writer thread are not
+// counted yet
+status_t
+log_get_stats(log_stats_t* out);
+
 void
 log_dump(void);
 
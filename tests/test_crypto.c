@@ -0,0 +1,208 @@
+#include "test_support.h"
+
+#include "crypto/crypto.h"
+#include "global/config.h"
+#include "global/user.h"
+#include "hal/hal_storage.h"
+#include "locksys.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_PASSWORD "Passw0rd!1"
+#define TEST_NEW_PASSWORD "N3wPassw0rd!"
+
+// RFC 4231 test cases 2, 6 and 7, kept apart from the tables crypto.c
+// tests itself with
+typedef struct {
+    const char* key; // NULL: 131 bytes of 0xaa
+    const char* message;
+    uint8_t     mac[32];
+} rfc4231_case_t;
+
+static const rfc4231_case_t rfc4231_cases[] = {
+    {"Jefe",
+     "what do ya want for nothing?",
+     {0x5b, 0xdc, 0xc1, 0x46, 0xbf, 0x60, 0x75, 0x4e,
+      0x6a, 0x04, 0x24, 0x26, 0x08, 0x95, 0x75, 0xc7,
+      0x5a, 0x00, 0x3f, 0x08, 0x9d, 0x27, 0x39, 0x83,
+      0x9d, 0xec, 0x58, 0xb9, 0x64, 0xec, 0x38, 0x43}},
+    {NULL,
+     "Test Using Larger Than Block-Size Key - Hash Key First",
+     {0x60, 0xe4, 0x31, 0x59, 0x1e, 0xe0, 0xb6, 0x7f,
+      0x0d, 0x8a, 0x26, 0xaa, 0xcb, 0xf5, 0xb7, 0x7f,
+      0x8e, 0x0b, 0xc6, 0x21, 0x37, 0x28, 0xc5, 0x14,
+      0x05, 0x46, 0x04, 0x0f, 0x0e, 0xe3, 0x7f, 0x54}},
+    {NULL,
+     "This is a test using a larger than block-size key and a larger than block-size data. The key "
+     "needs to be hashed before being used by the HMAC algorithm.",
+     {0x9b, 0x09, 0xff, 0xa7, 0x1b, 0x94, 0x2f, 0xcb,
+      0x27, 0x63, 0x5f, 0xbc, 0xd5, 0xb0, 0xe9, 0x44,
+      0xbf, 0xdc, 0x63, 0x64, 0x4f, 0x07, 0x13, 0x93,
+      0x8a, 0x7f, 0x51, 0x53, 0x5c, 0x3a, 0x35, 0xe2}},
+};
+
+static const uint32_t sha256_iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+static void backend_sha256(const crypto_backend_t* backend, const uint8_t* a, size_t a_len,
+                           const uint8_t* b, size_t b_len, uint8_t digest[32]) {
+    crypto_sha256_ctx_t ctx;
+
+    backend->resume(&ctx, sha256_iv, 0);
+    backend->update(&ctx, a, a_len);
+    backend->update(&ctx, b, b_len);
+    backend->final(&ctx, digest);
+}
+
+// Textbook HMAC on nothing but the backend's own hashing
+static void backend_hmac(const crypto_backend_t* backend, const rfc4231_case_t* tc,
+                         uint8_t mac[32]) {
+    uint8_t long_key[131];
+    uint8_t block[64] = {0};
+    uint8_t pad[64];
+    uint8_t inner[32];
+
+    memset(long_key, 0xaa, sizeof(long_key));
+    if (tc->key) {
+        memcpy(block, tc->key, strlen(tc->key));
+    } else {
+        backend_sha256(backend, long_key, sizeof(long_key), NULL, 0, block);
+    }
+
+    for (size_t i = 0; i < sizeof(pad); ++i) {
+        pad[i] = block[i] ^ 0x36;
+    }
+    backend_sha256(backend, pad, sizeof(pad), (const uint8_t*) tc->message, strlen(tc->message),
+                   inner);
+    for (size_t i = 0; i < sizeof(pad); ++i) {
+        pad[i] = block[i] ^ 0x5c;
+    }
+    backend_sha256(backend, pad, sizeof(pad), inner, sizeof(inner), mac);
+}
+
+static int boot_provision() {
+    system_state_t state = {0};
+
+    TEST_CHECK(hal_storage_set_system_state(&state) == STATUS_OK);
+    TEST_CHECK(user_add(ROOT_ADMIN_USERNAME, TEST_PASSWORD, 1) == STATUS_OK);
+
+    return 0;
+}
+
+// Passphrase checks on both entry points, none of which may touch the heap
+static int boot_unlock() {
+    char   passphrase[CONFIG_MAX_PASSWORD_LENGTH + 1];
+    char   new_passphrase[CONFIG_MAX_PASSWORD_LENGTH + 1];
+    size_t before;
+
+    TEST_CHECK(locksys_init() == STATUS_OK);
+
+    before = crypto_alloc_count();
+    strcpy(passphrase, TEST_PASSWORD);
+    TEST_CHECK(locksys_open_lock(ROOT_ADMIN_USERNAME, passphrase) == STATUS_OK);
+    TEST_CHECK(crypto_alloc_count() == before);
+
+    // A wrong current passphrase is refused by the same check
+    strcpy(passphrase, "Wr0ngPass!1");
+    strcpy(new_passphrase, TEST_NEW_PASSWORD);
+    TEST_CHECK(locksys_reset_passphrase(ROOT_ADMIN_USERNAME, passphrase, new_passphrase) ==
+               STATUS_ERR_AUTH);
+    TEST_CHECK(crypto_alloc_count() == before);
+
+    TEST_CHECK(locksys_shutdown() == STATUS_OK);
+
+    return 0;
+}
+
+void test_crypto_self_test() {
+    const crypto_backend_t* linked[] = {
+#if defined(CONFIG_SHA256_ACCEL)
+        &crypto_backend_native,
+#endif
+#if defined(CRYPTO_BACKEND_MBEDTLS)
+        &crypto_backend_mbedtls,
+#endif
+#if defined(CRYPTO_BACKEND_TINYCRYPT)
+        &crypto_backend_tinycrypt,
+#endif
+    };
+    size_t  cases = sizeof(rfc4231_cases) / sizeof(rfc4231_cases[0]);
+    uint8_t mac[32];
+
+    TEST_CHECK(crypto_self_test() == STATUS_OK);
+
+    // Each backend on its own, whether or not selection picked it
+    for (size_t b = 0; b < sizeof(linked) / sizeof(linked[0]); ++b) {
+        if (linked[b]->supported && !linked[b]->supported()) {
+            printf("  %s: not supported here, skipped\n", linked[b]->name);
+            continue;
+        }
+        for (size_t i = 0; i < cases; ++i) {
+            backend_hmac(linked[b], &rfc4231_cases[i], mac);
+            TEST_CHECK(memcmp(mac, rfc4231_cases[i].mac, sizeof(mac)) == 0);
+        }
+    }
+
+    // And the selected one through the public API
+    for (size_t i = 0; i < cases; ++i) {
+        const rfc4231_case_t* tc = &rfc4231_cases[i];
+        uint8_t               long_key[131];
+
+        memset(long_key, 0xaa, sizeof(long_key));
+        TEST_CHECK(get_hmac_sha256(tc->key ? (const uint8_t*) tc->key : long_key,
+                                   tc->key ? strlen(tc->key) : sizeof(long_key),
+                                   (const uint8_t*) tc->message, strlen(tc->message),
+                                   mac) == STATUS_OK);
+        TEST_CHECK(memcmp(mac, tc->mac, sizeof(mac)) == 0);
+    }
+
+    printf("test_crypto_self_test passes (%s).\n", crypto_backend_name());
+}
+
+// Batches that fill the lanes, leave a short last pass, or are shorter than
+// one pass must all agree with one MAC at a time
+void test_crypto_internal_hmac_many() {
+    static const size_t counts[] = {1, 3, 4, 5, 8, 11, 17};
+    uint8_t             messages[17][99];
+    uint8_t             macs[17][LOCKSYS_HASH_SIZE];
+    uint8_t             expected[LOCKSYS_HASH_SIZE];
+    uint8_t             unused[LOCKSYS_HASH_SIZE] = {0};
+    const uint8_t*      inputs[17];
+    uint8_t*            outputs[17];
+
+    for (size_t i = 0; i < 17; ++i) {
+        for (size_t j = 0; j < sizeof(messages[i]); ++j) {
+            messages[i][j] = (uint8_t) (i * 7 + j);
+        }
+        inputs[i]  = messages[i];
+        outputs[i] = macs[i];
+    }
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        memset(macs, 0, sizeof(macs));
+        TEST_CHECK(compute_internal_hmac_many(inputs, sizeof(messages[0]), outputs, counts[c]) ==
+                   STATUS_OK);
+        for (size_t i = 0; i < 17; ++i) {
+            if (i < counts[c]) {
+                TEST_CHECK(compute_internal_hmac(messages[i], sizeof(messages[i]), expected,
+                                                 sizeof(expected)) == STATUS_OK);
+                TEST_CHECK(memcmp(macs[i], expected, sizeof(expected)) == 0);
+            } else {
+                // Outputs past count are left alone
+                TEST_CHECK(memcmp(macs[i], unused, sizeof(unused)) == 0);
+            }
+        }
+    }
+
+    printf("test_crypto_internal_hmac_many passes.\n");
+}
+
+void test_crypto_unlock_allocations() {
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_provision) == 0);
+    TEST_CHECK(test_boot(boot_unlock) == 0);
+
+    printf("test_crypto_unlock_allocations passes.\n");
+}
@@ -0,0 +1,229 @@
+#include "test_support.h"
+
+#include "global/config.h"
+#include "logging/logging.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_EVENTS 200
+
+typedef struct {
+    uint32_t discarded;
+    uint8_t  reason;
+    uint32_t size;
+} discard_seen_t;
+
+static bool note_discard(const log_record_t* rec, void* ctx) {
+    discard_seen_t* seen = (discard_seen_t*) ctx;
+
+    if (rec->type == EVENT_LOG_DISCARDED && rec->payload_len == 5) {
+        seen->discarded++;
+        seen->reason = rec->payload[0];
+        seen->size   = (uint32_t) rec->payload[1] | (uint32_t) rec->payload[2] << 8 |
+                     (uint32_t) rec->payload[3] << 16 | (uint32_t) rec->payload[4] << 24;
+    }
+    return true;
+}
+
+static bool count_record(const log_record_t* rec, void* ctx) {
+    (void) rec;
+    (*(uint32_t*) ctx)++;
+    return true;
+}
+
+static int boot_write_events() {
+    TEST_CHECK(log_init() == STATUS_OK);
+    for (int i = 0; i < TEST_EVENTS; ++i) {
+        TEST_CHECK(log_write(EVENT_REQUEST_TO_UNLOCK, NULL, 0) == STATUS_OK);
+    }
+    TEST_CHECK(log_shutdown() == STATUS_OK);
+
+    return 0;
+}
+
+// Ends without log_shutdown, as a crash would: only the flush barrier
+// makes the records durable
+static int boot_write_flushed() {
+    TEST_CHECK(log_init() == STATUS_OK);
+    for (int i = 0; i < TEST_EVENTS; ++i) {
+        TEST_CHECK(log_write(EVENT_REQUEST_TO_UNLOCK, NULL, 0) == STATUS_OK);
+    }
+    TEST_CHECK(log_flush() == STATUS_OK);
+
+    return 0;
+}
+
+static int boot_expect_events() {
+    log_stats_t st;
+
+    TEST_CHECK(log_init() == STATUS_OK);
+    TEST_CHECK(log_verify() == STATUS_OK);
+    TEST_CHECK(log_get_stats(&st) == STATUS_OK);
+    TEST_CHECK(st.count[EVENT_REQUEST_TO_UNLOCK] == TEST_EVENTS);
+    TEST_CHECK(st.count[EVENT_LOG_DISCARDED] == 0);
+
+    return 0;
+}
+
+// Returns the reason recorded in the single discard event of the new log
+static int boot_expect_discard() {
+    discard_seen_t seen = {0};
+    log_stats_t    st;
+
+    TEST_CHECK(log_init() == STATUS_OK);
+    TEST_CHECK(log_verify() == STATUS_OK);
+    TEST_CHECK(log_get_stats(&st) == STATUS_OK);
+    TEST_CHECK(st.count[EVENT_REQUEST_TO_UNLOCK] == 0);
+    TEST_CHECK(log_query(0, UINT32_MAX, LOG_EVENT_BIT(EVENT_LOG_DISCARDED), note_discard, &seen) ==
+               STATUS_OK);
+    TEST_CHECK(seen.discarded == 1);
+    TEST_CHECK(seen.size == test_file_size(LOG_RETIRED_FILENAME));
+
+    return seen.reason;
+}
+
+// Returns the status of a query over everything, which must still have
+// streamed the events it could authenticate
+static int boot_query_all() {
+    uint32_t seen = 0;
+    status_t status;
+
+    TEST_CHECK(log_init() == STATUS_OK);
+    status = log_query(0, UINT32_MAX, LOG_QUERY_ALL_TYPES, count_record, &seen);
+    TEST_CHECK(seen > 0);
+    TEST_CHECK(status != STATUS_OK || seen == TEST_EVENTS);
+
+    return status;
+}
+
+#if CONFIG_LOG_SEGMENT_PAGES > 0
+// Large events, so the ring wraps several times and seals segments
+static int boot_wrap_ring() {
+    uint8_t payload[100];
+
+    memset(payload, 0x3c, sizeof(payload));
+    TEST_CHECK(log_init() == STATUS_OK);
+    for (int i = 0; i < TEST_EVENTS; ++i) {
+        TEST_CHECK(log_write(EVENT_REQUEST_TO_UNLOCK, payload, sizeof(payload)) == STATUS_OK);
+    }
+    TEST_CHECK(log_shutdown() == STATUS_OK);
+
+    return 0;
+}
+
+static int boot_remove_segment() {
+    TEST_CHECK(log_init() == STATUS_OK);
+    TEST_CHECK(log_verify() == STATUS_OK);
+    TEST_CHECK(log_verify_segments() == STATUS_OK);
+    TEST_CHECK(log_remove_segment(0) == STATUS_OK);
+    TEST_CHECK(log_verify_segments() == STATUS_OK);
+
+    return 0;
+}
+
+static int boot_verify_segments() {
+    TEST_CHECK(log_init() == STATUS_OK);
+
+    return log_verify_segments();
+}
+
+static void segment_name(uint32_t segment, char* out, size_t out_len) {
+    snprintf(out, out_len, LOG_SEGMENT_DIR "%08x.seg", (unsigned) segment);
+}
+#endif
+
+static int boot_expect_tamper() {
+    TEST_CHECK(log_init() == STATUS_ERR_TAMPER);
+
+    return 0;
+}
+
+void test_log_reopen() {
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_write_events) == 0);
+    TEST_CHECK(test_boot(boot_expect_events) == 0);
+    TEST_CHECK(test_file_size(LOG_RETIRED_FILENAME) == 0);
+
+    printf("test_log_reopen passes.\n");
+}
+
+void test_log_flush_barrier() {
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_write_flushed) == 0);
+    TEST_CHECK(test_boot(boot_expect_events) == 0);
+
+    printf("test_log_flush_barrier passes.\n");
+}
+
+void test_log_resized_file() {
+    size_t size;
+
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_write_events) == 0);
+    size = test_file_size(LOG_STORAGE_FILENAME);
+
+    // One byte more: the old file is kept aside, not zeroed
+    test_file_resize(LOG_STORAGE_FILENAME, size + 1);
+    TEST_CHECK(test_boot(boot_expect_discard) == LOG_DISCARD_SIZE);
+    TEST_CHECK(test_file_size(LOG_RETIRED_FILENAME) == size + 1);
+
+    // With that one still there, a second mismatch is refused outright
+    test_file_resize(LOG_STORAGE_FILENAME, size - 1);
+    TEST_CHECK(test_boot(boot_expect_tamper) == 0);
+    TEST_CHECK(test_file_size(LOG_STORAGE_FILENAME) == size - 1);
+
+    printf("test_log_resized_file passes.\n");
+}
+
+void test_log_unreadable_header() {
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_write_events) == 0);
+    test_file_flip_bit(LOG_STORAGE_FILENAME, 0, 0);
+    TEST_CHECK(test_boot(boot_expect_discard) == LOG_DISCARD_UNREADABLE);
+
+    printf("test_log_unreadable_header passes.\n");
+}
+
+void test_log_query_damaged_page() {
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_write_events) == 0);
+    TEST_CHECK(test_boot(boot_query_all) == STATUS_OK);
+
+    // A frame in the oldest page no longer authenticates
+    test_file_flip_bit(LOG_STORAGE_FILENAME, log_page_offset(0) + CONFIG_LOG_PAGE_SIZE / 2, 3);
+    TEST_CHECK(test_boot(boot_query_all) == STATUS_ERR_TAMPER);
+
+    // Nor does its header
+    test_file_flip_bit(LOG_STORAGE_FILENAME, log_page_offset(0) + CONFIG_LOG_PAGE_SIZE / 2, 3);
+    test_file_flip_bit(LOG_STORAGE_FILENAME, log_page_offset(0), 0);
+    TEST_CHECK(test_boot(boot_query_all) == STATUS_ERR_TAMPER);
+
+    printf("test_log_query_damaged_page passes.\n");
+}
+
+void test_log_segments() {
+#if CONFIG_LOG_SEGMENT_PAGES > 0
+    char first[64];
+    char second[64];
+
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_wrap_ring) == 0);
+    segment_name(0, first, sizeof(first));
+    segment_name(1, second, sizeof(second));
+    TEST_CHECK(test_file_size(first) > 0);
+    TEST_CHECK(test_file_size(second) > 0);
+
+    // A removed segment leaves its seal, which still checks out
+    TEST_CHECK(test_boot(boot_remove_segment) == 0);
+    TEST_CHECK(test_file_size(first) == 0);
+    TEST_CHECK(test_boot(boot_verify_segments) == STATUS_OK);
+
+    // A page of a kept segment no longer matches its seal
+    test_file_flip_bit(second, CONFIG_LOG_PAGE_SIZE / 2, 3);
+    TEST_CHECK(test_boot(boot_verify_segments) == STATUS_ERR_TAMPER);
+
+    printf("test_log_segments passes.\n");
+#endif
+}
@@ -1,13 +1,76 @@
 #include <stdio.h>
+#include <string.h>
 
 void test_template_example_one();
 void test_template_example_two();
 
-int main(void) {
+void test_storage_migrate_v1();
+void test_storage_migrate_v2();
+void test_storage_migrate_interrupted();
+void test_storage_corrupt_header();
+void test_storage_cleared_bitmap();
+void test_storage_counters_swap();
+void test_storage_migrate_v3();
+
+void test_log_reopen();
+void test_log_flush_barrier();
+void test_log_resized_file();
+void test_log_unreadable_header();
+void test_log_query_damaged_page();
+void test_log_segments();
+
+void test_user_add_remove();
+void test_user_txn_abort();
+void test_user_compact();
+void test_user_cache_invalidation();
+void test_user_fill();
+
+void test_crypto_self_test();
+void test_crypto_internal_hmac_many();
+void test_crypto_unlock_allocations();
+
+typedef struct {
+    const char* suite;
+    void (*run)();
+} test_case_t;
+
+static const test_case_t test_cases[] = {
+    {"storage", test_storage_migrate_v1},
+    {"storage", test_storage_migrate_v2},
+    {"storage", test_storage_migrate_interrupted},
+    {"storage", test_storage_corrupt_header},
+    {"storage", test_storage_cleared_bitmap},
+    {"storage", test_storage_counters_swap},
+    {"storage", test_storage_migrate_v3},
+    {"log", test_log_reopen},
+    {"log", test_log_flush_barrier},
+    {"log", test_log_resized_file},
+    {"log", test_log_unreadable_header},
+    {"log", test_log_query_damaged_page},
+    {"log", test_log_segments},
+    {"user", test_user_add_remove},
+    {"user", test_user_txn_abort},
+    {"user", test_user_compact},
+    {"user", test_user_cache_invalidation},
+    {"user", test_user_fill},
+    {"crypto", test_crypto_self_test},
+    {"crypto", test_crypto_internal_hmac_many},
+    {"crypto", test_crypto_unlock_allocations},
+    {"template", test_template_example_one},
+    {"template", test_template_example_two},
+};
+
+// With no argument every suite runs; otherwise only the one named
+int main(int argc, char** argv) {
+    const char* only = (argc > 1) ? argv[1] : NULL;
+
     printf("Running LockSys unit tests...\n");
 
-    test_template_example_one();
-    test_template_example_two();
+    for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); ++i) {
+        if (!only || strcmp(only, test_cases[i].suite) == 0) {
+            test_cases[i].run();
+        }
+    }
 
     return 0;
 }
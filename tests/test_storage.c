@@ -0,0 +1,306 @@
+#include "test_support.h"
+
+#include "crypto/crypto.h"
+#include "global/config.h"
+#include "global/user.h"
+#include "hal/hal_storage.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_PASSWORD "Passw0rd!1"
+
+// Images as written before format version 3, mirrored from hal_storage_layout.c
+typedef struct __attribute__((packed)) {
+    char     username[MAX_USERNAME_LEN];
+    uint8_t  password_hmac[LOCKSYS_HASH_SIZE];
+    uint8_t  failed_attempts_since_login;
+    uint32_t last_attempt_timestamp;
+    uint32_t created_timestamp;
+    uint32_t password_last_set;
+    uint8_t  user_flags;
+    uint8_t  reserved[2];
+    uint8_t  record_hmac[LOCKSYS_HASH_SIZE];
+} legacy_record_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t capacity;
+    uint32_t bitmap_offset;
+    uint8_t  reserved[16];
+    uint8_t  hmac[LOCKSYS_HASH_SIZE];
+} legacy_header_t;
+
+#define STORAGE_MAGIC 0x59534B4Cu
+#define BITMAP_WORDS(cap) (((size_t) (cap) + 31) / 32)
+#define SLOT_SIZE (sizeof(user_record_t) + sizeof(user_counters_t))
+#define BITMAP_OFFSET (128 + (size_t) MAX_USERS * SLOT_SIZE)
+#define IMAGE_SIZE (BITMAP_OFFSET + BITMAP_WORDS(MAX_USERS) * sizeof(uint32_t))
+#define SLOT_OFFSET(i) (128 + (size_t) (i) * SLOT_SIZE)
+#define V1_SIZE (11 * sizeof(legacy_record_t))
+#define V2_RECORDS_OFFSET (64 + sizeof(legacy_record_t))
+#define V2_SIZE(cap)                                                                               \
+    (V2_RECORDS_OFFSET + (size_t) (cap) * sizeof(legacy_record_t) +                               \
+     BITMAP_WORDS(cap) * sizeof(uint32_t))
+
+static void legacy_record(const char* name, legacy_record_t* rec) {
+    memset(rec, 0, sizeof(*rec));
+    strncpy(rec->username, name, sizeof(rec->username));
+    rec->user_flags = USER_FLAG_IS_ENABLED;
+    TEST_CHECK(compute_internal_hmac((const uint8_t*) TEST_PASSWORD, strlen(TEST_PASSWORD),
+                                     rec->password_hmac, sizeof(rec->password_hmac)) == STATUS_OK);
+    TEST_CHECK(compute_internal_hmac((const uint8_t*) rec, offsetof(legacy_record_t, record_hmac),
+                                     rec->record_hmac, sizeof(rec->record_hmac)) == STATUS_OK);
+}
+
+// Version 1: ten records at offset 0 followed by the state slot
+static void write_v1_image(size_t offset) {
+    legacy_record_t recs[V1_SIZE / sizeof(legacy_record_t)];
+
+    memset(recs, 0, sizeof(recs));
+    legacy_record(ROOT_ADMIN_USERNAME, &recs[0]);
+    legacy_record("alice", &recs[1]);
+    test_file_write(STORAGE_FILENAME, offset, recs, sizeof(recs));
+}
+
+static void write_v2_image(uint32_t capacity) {
+    legacy_header_t hdr = {0};
+    legacy_record_t rec;
+    uint32_t        bitmap = 0x3;
+
+    hdr.magic         = STORAGE_MAGIC;
+    hdr.version       = 2;
+    hdr.record_size   = sizeof(legacy_record_t);
+    hdr.capacity      = capacity;
+    hdr.bitmap_offset = (uint32_t) (V2_SIZE(capacity) - BITMAP_WORDS(capacity) * sizeof(uint32_t));
+    TEST_CHECK(compute_internal_hmac((const uint8_t*) &hdr, offsetof(legacy_header_t, hmac),
+                                     hdr.hmac, sizeof(hdr.hmac)) == STATUS_OK);
+
+    test_file_resize(STORAGE_FILENAME, V2_SIZE(capacity));
+    test_file_write(STORAGE_FILENAME, 0, &hdr, sizeof(hdr));
+    legacy_record(ROOT_ADMIN_USERNAME, &rec);
+    test_file_write(STORAGE_FILENAME, V2_RECORDS_OFFSET, &rec, sizeof(rec));
+    legacy_record("alice", &rec);
+    test_file_write(STORAGE_FILENAME, V2_RECORDS_OFFSET + sizeof(rec), &rec, sizeof(rec));
+    test_file_write(STORAGE_FILENAME, hdr.bitmap_offset, &bitmap, sizeof(bitmap));
+}
+
+static int boot_provision() {
+    system_state_t state = {0};
+
+    TEST_CHECK(hal_storage_set_system_state(&state) == STATUS_OK);
+    TEST_CHECK(user_add(ROOT_ADMIN_USERNAME, TEST_PASSWORD, 1) == STATUS_OK);
+    TEST_CHECK(user_add("alice", TEST_PASSWORD, 0) == STATUS_OK);
+
+    return 0;
+}
+
+static int boot_add_bob() {
+    TEST_CHECK(user_add("bob", TEST_PASSWORD, 0) == STATUS_OK);
+
+    return 0;
+}
+
+static int boot_lock_alice() {
+    user_txn_t txn;
+
+    TEST_CHECK(user_txn_begin("alice", &txn) == STATUS_OK);
+    txn.counters.flags |= USER_FLAG_IS_LOCKED;
+    txn.counters_dirty = true;
+    TEST_CHECK(user_txn_commit(&txn) == STATUS_OK);
+
+    return 0;
+}
+
+static int boot_expect_alice_rejected() {
+    user_index_t  index;
+    user_record_t rec;
+    user_txn_t    txn;
+
+    TEST_CHECK(user_find_by_username("alice", &index, &rec) == STATUS_OK);
+    TEST_CHECK(index == 2);
+    TEST_CHECK(user_txn_begin("alice", &txn) != STATUS_OK);
+
+    return 0;
+}
+
+static int boot_expect_alice_unlocked() {
+    user_txn_t txn;
+
+    TEST_CHECK(user_txn_begin("alice", &txn) == STATUS_OK);
+    TEST_CHECK((txn.counters.flags & USER_FLAG_IS_LOCKED) == 0);
+    user_txn_abort(&txn);
+
+    return 0;
+}
+
+static int boot_expect_users() {
+    user_index_t  index;
+    user_record_t rec;
+
+    TEST_CHECK(hal_storage_init() == STATUS_OK);
+    TEST_CHECK(user_index_build() == STATUS_OK);
+    TEST_CHECK(user_find_by_username(ROOT_ADMIN_USERNAME, &index, &rec) == STATUS_OK);
+    TEST_CHECK(user_find_by_username("alice", &index, &rec) == STATUS_OK);
+
+    return 0;
+}
+
+static int boot_expect_tamper() {
+    TEST_CHECK(hal_storage_init() == STATUS_ERR_TAMPER);
+
+    return 0;
+}
+
+void test_storage_migrate_v1() {
+    test_wipe_storage();
+    write_v1_image(0);
+
+    TEST_CHECK(test_boot(boot_expect_users) == 0);
+    TEST_CHECK(test_file_size(STORAGE_FILENAME) == IMAGE_SIZE);
+    // Migrated once; the next boot opens the current format
+    TEST_CHECK(test_boot(boot_expect_users) == 0);
+
+    printf("test_storage_migrate_v1 passes.\n");
+}
+
+void test_storage_migrate_v2() {
+    test_wipe_storage();
+    write_v2_image(MAX_USERS);
+
+    TEST_CHECK(test_boot(boot_expect_users) == 0);
+    TEST_CHECK(test_file_size(STORAGE_FILENAME) == IMAGE_SIZE);
+
+    printf("test_storage_migrate_v2 passes.\n");
+}
+
+void test_storage_migrate_interrupted() {
+    uint8_t junk[64];
+
+    memset(junk, 0x5a, sizeof(junk));
+
+    // Parked copy complete, head partly rewritten: restart from the copy
+    test_wipe_storage();
+    write_v1_image(0);
+    test_file_resize(STORAGE_FILENAME, IMAGE_SIZE);
+    write_v1_image(IMAGE_SIZE);
+    test_file_write(STORAGE_FILENAME, 128, junk, sizeof(junk));
+    TEST_CHECK(test_boot(boot_expect_users) == 0);
+    TEST_CHECK(test_file_size(STORAGE_FILENAME) == IMAGE_SIZE);
+
+    // Still parking (one byte past the copy): the original is intact
+    test_wipe_storage();
+    write_v1_image(0);
+    test_file_resize(STORAGE_FILENAME, IMAGE_SIZE + V1_SIZE + 1);
+    TEST_CHECK(test_boot(boot_expect_users) == 0);
+    TEST_CHECK(test_file_size(STORAGE_FILENAME) == IMAGE_SIZE);
+
+    printf("test_storage_migrate_interrupted passes.\n");
+}
+
+void test_storage_corrupt_header() {
+    // A damaged header on a current image is neither migrated nor rewritten
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_provision) == 0);
+    test_file_flip_bit(STORAGE_FILENAME, 0, 0);
+    TEST_CHECK(test_boot(boot_expect_tamper) == 0);
+    test_file_flip_bit(STORAGE_FILENAME, 0, 0);
+    TEST_CHECK(test_boot(boot_expect_users) == 0);
+
+    // Nor is an image grown past any known size
+    test_file_flip_bit(STORAGE_FILENAME, 0, 0);
+    test_file_resize(STORAGE_FILENAME, IMAGE_SIZE + 1);
+    TEST_CHECK(test_boot(boot_expect_tamper) == 0);
+
+    // A small version 2 image with a damaged header fits the version 1 size
+    test_wipe_storage();
+    write_v2_image(4);
+    test_file_flip_bit(STORAGE_FILENAME, 0, 0);
+    TEST_CHECK(test_boot(boot_expect_tamper) == 0);
+
+    printf("test_storage_corrupt_header passes.\n");
+}
+
+void test_storage_cleared_bitmap() {
+    uint32_t bitmap = 0;
+
+    // The bitmap is not authenticated: clearing a bit must not hide the user
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_provision) == 0);
+    test_file_read(STORAGE_FILENAME, BITMAP_OFFSET, &bitmap, sizeof(bitmap));
+    TEST_CHECK(bitmap == 0x3);
+    bitmap = 0;
+    test_file_write(STORAGE_FILENAME, BITMAP_OFFSET, &bitmap, sizeof(bitmap));
+
+    TEST_CHECK(test_boot(boot_expect_users) == 0);
+    test_file_read(STORAGE_FILENAME, BITMAP_OFFSET, &bitmap, sizeof(bitmap));
+    TEST_CHECK(bitmap == 0x3);
+
+    printf("test_storage_cleared_bitmap passes.\n");
+}
+
+void test_storage_counters_swap() {
+    user_record_t rec;
+    uint8_t       blank[SLOT_SIZE];
+
+    // A locked user's record moved next to another user's clean counters
+    // must not pick them up
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_provision) == 0);
+    TEST_CHECK(test_boot(boot_add_bob) == 0);
+    TEST_CHECK(test_boot(boot_lock_alice) == 0);
+
+    memset(blank, 0, sizeof(blank));
+    test_file_read(STORAGE_FILENAME, SLOT_OFFSET(1), &rec, sizeof(rec));
+    test_file_write(STORAGE_FILENAME, SLOT_OFFSET(2), &rec, sizeof(rec));
+    test_file_write(STORAGE_FILENAME, SLOT_OFFSET(1), blank, sizeof(blank));
+    TEST_CHECK(test_boot(boot_expect_alice_rejected) == 0);
+
+    printf("test_storage_counters_swap passes.\n");
+}
+
+// Counters MAC as written by format version 3: bound to the slot index
+static void v3_counters_mac(uint32_t slot, user_counters_t* counters) {
+    hmac_sha256_ctx_t ctx;
+    uint8_t           index[4] = {(uint8_t) slot, (uint8_t) (slot >> 8), (uint8_t) (slot >> 16),
+                                  (uint8_t) (slot >> 24)};
+    uint8_t           full[LOCKSYS_HASH_SIZE];
+
+    TEST_CHECK(compute_internal_hmac_init(&ctx) == STATUS_OK);
+    hmac_sha256_update(&ctx, index, sizeof(index));
+    hmac_sha256_update(&ctx, (const uint8_t*) counters, offsetof(user_counters_t, hmac));
+    TEST_CHECK(hmac_sha256_final(&ctx, full) == STATUS_OK);
+    memcpy(counters->hmac, full, sizeof(counters->hmac));
+}
+
+void test_storage_migrate_v3() {
+    legacy_header_t hdr;
+    user_counters_t counters;
+
+    // Rewrite a current image as version 3 wrote it: same layout, slot-bound counters
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_provision) == 0);
+    test_file_read(STORAGE_FILENAME, 0, &hdr, sizeof(hdr));
+    hdr.version = 3;
+    TEST_CHECK(compute_internal_hmac((const uint8_t*) &hdr, offsetof(legacy_header_t, hmac),
+                                     hdr.hmac, sizeof(hdr.hmac)) == STATUS_OK);
+    test_file_write(STORAGE_FILENAME, 0, &hdr, sizeof(hdr));
+    for (uint32_t i = 0; i < 2; ++i) {
+        test_file_read(STORAGE_FILENAME, SLOT_OFFSET(i) + sizeof(user_record_t), &counters,
+                       sizeof(counters));
+        v3_counters_mac(i, &counters);
+        test_file_write(STORAGE_FILENAME, SLOT_OFFSET(i) + sizeof(user_record_t), &counters,
+                        sizeof(counters));
+    }
+
+    TEST_CHECK(test_boot(boot_expect_users) == 0);
+    test_file_read(STORAGE_FILENAME, 0, &hdr, sizeof(hdr));
+    TEST_CHECK(hdr.version == 4);
+    TEST_CHECK(test_boot(boot_expect_alice_unlocked) == 0);
+
+    printf("test_storage_migrate_v3 passes.\n");
+}
@@ -0,0 +1,127 @@
+#include "test_support.h"
+
+#include "global/config.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+void test_path(const char* relative, char* out, size_t out_len) {
+    char    exe[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+
+    TEST_CHECK(len > 0);
+    exe[len] = '\0';
+    *(strrchr(exe, '/') + 1) = '\0';
+    snprintf(out, out_len, "%s%s", exe, relative);
+}
+
+void test_wipe_storage() {
+    char           path[PATH_MAX];
+    DIR*           dir;
+    struct dirent* entry;
+
+    test_path(STORAGE_FILENAME, path, sizeof(path));
+    unlink(path);
+    test_path(LOG_STORAGE_FILENAME, path, sizeof(path));
+    unlink(path);
+    test_path(LOG_RETIRED_FILENAME, path, sizeof(path));
+    unlink(path);
+
+    test_path(LOG_SEGMENT_DIR, path, sizeof(path));
+    dir = opendir(path);
+    while (dir && (entry = readdir(dir)) != NULL) {
+        char file[PATH_MAX + 256];
+
+        if (entry->d_name[0] != '.') {
+            snprintf(file, sizeof(file), "%s%s", path, entry->d_name);
+            unlink(file);
+        }
+    }
+    if (dir) {
+        closedir(dir);
+    }
+
+    test_path("storage", path, sizeof(path));
+    mkdir(path, 0755);
+}
+
+int test_boot(int (*step)()) {
+    int   status = 0;
+    pid_t pid;
+
+    fflush(NULL);
+    pid = fork();
+    TEST_CHECK(pid >= 0);
+    if (pid == 0) {
+        _exit(step());
+    }
+
+    if (waitpid(pid, &status, 0) != pid) {
+        return -1;
+    }
+
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int open_file(const char* relative, int flags) {
+    char path[PATH_MAX];
+    int  fd;
+
+    test_path(relative, path, sizeof(path));
+    fd = open(path, flags, 0600);
+    TEST_CHECK(fd >= 0);
+
+    return fd;
+}
+
+size_t test_file_size(const char* relative) {
+    char        path[PATH_MAX];
+    struct stat st;
+
+    test_path(relative, path, sizeof(path));
+    if (stat(path, &st) != 0) {
+        return 0;
+    }
+
+    return (size_t) st.st_size;
+}
+
+void test_file_read(const char* relative, size_t offset, void* dst, size_t len) {
+    int     fd = open_file(relative, O_RDONLY);
+    ssize_t n  = pread(fd, dst, len, (off_t) offset);
+
+    TEST_CHECK(n == (ssize_t) len);
+    close(fd);
+}
+
+void test_file_write(const char* relative, size_t offset, const void* src, size_t len) {
+    int     fd = open_file(relative, O_RDWR | O_CREAT);
+    ssize_t n  = pwrite(fd, src, len, (off_t) offset);
+
+    TEST_CHECK(n == (ssize_t) len);
+    close(fd);
+}
+
+void test_file_resize(const char* relative, size_t size) {
+    int fd = open_file(relative, O_RDWR | O_CREAT);
+    int rc = ftruncate(fd, (off_t) size);
+
+    TEST_CHECK(rc == 0);
+    close(fd);
+}
+
+void test_file_flip_bit(const char* relative, size_t offset, unsigned bit) {
+    uint8_t byte;
+
+    test_file_read(relative, offset, &byte, 1);
+    byte ^= (uint8_t) (1u << bit);
+    test_file_write(relative, offset, &byte, 1);
+}
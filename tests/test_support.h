@@ -0,0 +1,39 @@
+#ifndef TESTS_TEST_SUPPORT_H_
+#define TESTS_TEST_SUPPORT_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Like assert(), but always evaluated and reported with its location
+#define TEST_CHECK(expr)                                                                           \
+    do {                                                                                           \
+        if (!(expr)) {                                                                             \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr);              \
+            abort();                                                                               \
+        }                                                                                          \
+    } while (0)
+
+// The POSIX HAL keeps its files next to the executable and every module
+// holds its state in statics, so a test drives the system in child
+// processes (one per simulated boot) and edits the files in between.
+
+// Absolute path of a file the HAL names relative to the executable
+void test_path(const char* relative, char* out, size_t out_len);
+
+// Remove the storage image, the log ring (and one set aside) and any
+// sealed log segments
+void test_wipe_storage();
+
+// Run step in a fresh child process; returns its result, or -1 if it
+// crashed or failed a check
+int test_boot(int (*step)());
+
+// Raw access to a HAL file, asserting on I/O errors
+size_t test_file_size(const char* relative);
+void test_file_read(const char* relative, size_t offset, void* dst, size_t len);
+void test_file_write(const char* relative, size_t offset, const void* src, size_t len);
+void test_file_resize(const char* relative, size_t size);
+void test_file_flip_bit(const char* relative, size_t offset, unsigned bit);
+
+#endif // TESTS_TEST_SUPPORT_H_
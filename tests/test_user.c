@@ -0,0 +1,252 @@
+#include "test_support.h"
+
+#include "global/config.h"
+#include "global/user.h"
+#include "hal/hal_storage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_PASSWORD "Passw0rd!1"
+#define SLOT_OFFSET(i) (128 + (size_t) (i) * (sizeof(user_record_t) + sizeof(user_counters_t)))
+
+static int boot_provision() {
+    system_state_t state = {0};
+
+    TEST_CHECK(hal_storage_set_system_state(&state) == STATUS_OK);
+    TEST_CHECK(user_add(ROOT_ADMIN_USERNAME, TEST_PASSWORD, 1) == STATUS_OK);
+    TEST_CHECK(user_add("alice", TEST_PASSWORD, 0) == STATUS_OK);
+    TEST_CHECK(user_add("bob", TEST_PASSWORD, 0) == STATUS_OK);
+
+    return 0;
+}
+
+// Returns the slot alice is found in
+static int boot_find_alice() {
+    user_index_t  index;
+    user_record_t rec;
+
+    TEST_CHECK(user_find_by_username("alice", &index, &rec) == STATUS_OK);
+    TEST_CHECK(strcmp(rec.username, "alice") == 0);
+    TEST_CHECK(user_find_by_username("bob", &index, &rec) == STATUS_OK);
+    TEST_CHECK(user_find_by_username("carol", &index, &rec) == STATUS_ERR_NOT_FOUND);
+    TEST_CHECK(user_find_by_username("alice", &index, &rec) == STATUS_OK);
+
+    return (int) index;
+}
+
+static int boot_remove_alice() {
+    user_index_t  index;
+    user_record_t rec;
+
+    TEST_CHECK(user_remove("alice") == STATUS_OK);
+    TEST_CHECK(user_find_by_username("alice", &index, &rec) == STATUS_ERR_NOT_FOUND);
+    TEST_CHECK(user_find_by_username("bob", &index, &rec) == STATUS_OK);
+    TEST_CHECK(user_remove("alice") == STATUS_ERR_NOT_FOUND);
+
+    return 0;
+}
+
+static int boot_expect_no_alice() {
+    user_index_t  index;
+    user_record_t rec;
+
+    TEST_CHECK(user_find_by_username("alice", &index, &rec) == STATUS_ERR_NOT_FOUND);
+    TEST_CHECK(user_find_by_username("bob", &index, &rec) == STATUS_OK);
+
+    return 0;
+}
+
+static int boot_readd_alice() {
+    TEST_CHECK(user_add("alice", TEST_PASSWORD, 0) == STATUS_OK);
+    TEST_CHECK(user_add("alice", TEST_PASSWORD, 0) != STATUS_OK);
+
+    return 0;
+}
+
+static int boot_compact() {
+    user_index_t  index;
+    user_record_t rec;
+    user_txn_t    txn;
+    uint32_t      moved = 0;
+
+    TEST_CHECK(user_add("carol", TEST_PASSWORD, 0) == STATUS_OK);
+    TEST_CHECK(user_find_by_username("carol", &index, &rec) == STATUS_OK);
+    TEST_CHECK(index == 3);
+    TEST_CHECK(user_remove("alice") == STATUS_OK);
+
+    // Only carol sits above the hole alice left
+    TEST_CHECK(user_compact_step(4, &moved) == STATUS_OK);
+    TEST_CHECK(moved == 1);
+    TEST_CHECK(user_find_by_username("carol", &index, &rec) == STATUS_OK);
+    TEST_CHECK(index == 1);
+    TEST_CHECK(user_txn_begin("carol", &txn) == STATUS_OK);
+    user_txn_abort(&txn);
+
+    return 0;
+}
+
+// Returns the slot carol is found in
+static int boot_find_carol() {
+    user_index_t  index;
+    user_record_t rec;
+    user_txn_t    txn;
+    uint32_t      moved = 1;
+
+    TEST_CHECK(user_find_by_username("carol", &index, &rec) == STATUS_OK);
+    TEST_CHECK(user_find_by_username("bob", &index, &rec) == STATUS_OK);
+    TEST_CHECK(user_txn_begin("carol", &txn) == STATUS_OK);
+    user_txn_abort(&txn);
+    TEST_CHECK(user_compact_step(4, &moved) == STATUS_OK);
+    TEST_CHECK(moved == 0);
+    TEST_CHECK(user_find_by_username("carol", &index, &rec) == STATUS_OK);
+
+    return (int) index;
+}
+
+static int boot_cache_invalidation() {
+    user_index_t  index;
+    user_record_t good;
+    user_record_t bad;
+
+    TEST_CHECK(user_find_by_username("alice", &index, &good) == STATUS_OK);
+    bad = good;
+    bad.password_hmac[0] ^= 1;
+
+    // A record write this module did not make moves the generation on
+    TEST_CHECK(hal_storage_user_set(index, &bad) == STATUS_OK);
+    TEST_CHECK(user_find_by_username("alice", &index, &bad) == STATUS_ERR_NOT_FOUND);
+    TEST_CHECK(hal_storage_user_set(index, &good) == STATUS_OK);
+    TEST_CHECK(user_find_by_username("alice", &index, &bad) == STATUS_OK);
+
+    // One behind the HAL's back is only caught by the periodic re-read
+    bad.password_hmac[0] ^= 1;
+    test_file_write(STORAGE_FILENAME, SLOT_OFFSET(index), &bad, sizeof(bad));
+#if CONFIG_USER_CACHE_ENTRIES > 0
+    TEST_CHECK(user_find_by_username("alice", &index, &bad) == STATUS_OK);
+    TEST_CHECK(user_cache_step(CONFIG_USER_CACHE_REVERIFY_SECONDS) == STATUS_ERR_TAMPER);
+#endif
+    TEST_CHECK(user_find_by_username("alice", &index, &bad) == STATUS_ERR_NOT_FOUND);
+
+    return 0;
+}
+
+// Every slot taken: root in slot 0, user<n> in slot n
+static int boot_fill() {
+    system_state_t state = {0};
+    char           name[MAX_USERNAME_LEN];
+
+    TEST_CHECK(hal_storage_set_system_state(&state) == STATUS_OK);
+    TEST_CHECK(user_add(ROOT_ADMIN_USERNAME, TEST_PASSWORD, 1) == STATUS_OK);
+    for (unsigned i = 1; i < MAX_USERS; ++i) {
+        snprintf(name, sizeof(name), "user%u", i);
+        TEST_CHECK(user_add(name, TEST_PASSWORD, 0) == STATUS_OK);
+    }
+    TEST_CHECK(user_add("extra", TEST_PASSWORD, 0) == STATUS_ERR_FULL);
+
+    return 0;
+}
+
+// Returns the slot the user added into the freed middle slot lands in
+static int boot_refill_middle() {
+    user_index_t  index;
+    user_record_t rec;
+    char          name[MAX_USERNAME_LEN];
+
+    snprintf(name, sizeof(name), "user%u", (unsigned) (MAX_USERS - 1));
+    TEST_CHECK(user_find_by_username(name, &index, &rec) == STATUS_OK);
+    TEST_CHECK(index == MAX_USERS - 1);
+    snprintf(name, sizeof(name), "user%u", (unsigned) (MAX_USERS / 2));
+    TEST_CHECK(user_remove(name) == STATUS_OK);
+    TEST_CHECK(user_add("extra", TEST_PASSWORD, 0) == STATUS_OK);
+    TEST_CHECK(user_find_by_username("extra", &index, &rec) == STATUS_OK);
+
+    return (int) (index == MAX_USERS / 2);
+}
+
+static int boot_abort_alice() {
+    user_txn_t txn;
+
+    TEST_CHECK(user_txn_begin("alice", &txn) == STATUS_OK);
+    txn.record.user_flags |= USER_FLAG_IS_ADMIN;
+    txn.record.password_last_set++;
+    txn.dirty = true;
+    txn.counters.failed_attempts_since_login++;
+    txn.counters.flags |= USER_FLAG_IS_LOCKED;
+    txn.counters_dirty = true;
+    user_txn_abort(&txn);
+
+    // Nothing reached storage or the cache
+    TEST_CHECK(user_txn_begin("alice", &txn) == STATUS_OK);
+    TEST_CHECK((txn.record.user_flags & USER_FLAG_IS_ADMIN) == 0);
+    TEST_CHECK(txn.counters.failed_attempts_since_login == 0);
+    TEST_CHECK((txn.counters.flags & USER_FLAG_IS_LOCKED) == 0);
+    user_txn_abort(&txn);
+
+    return 0;
+}
+
+void test_user_add_remove() {
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_provision) == 0);
+    TEST_CHECK(test_boot(boot_find_alice) == 1);
+
+    // Gone from the index at once and from storage across a boot
+    TEST_CHECK(test_boot(boot_remove_alice) == 0);
+    TEST_CHECK(test_boot(boot_expect_no_alice) == 0);
+
+    // The freed slot is reused
+    TEST_CHECK(test_boot(boot_readd_alice) == 0);
+    TEST_CHECK(test_boot(boot_find_alice) == 1);
+
+    printf("test_user_add_remove passes.\n");
+}
+
+void test_user_txn_abort() {
+    uint8_t* before;
+    uint8_t* after;
+    size_t   size;
+
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_provision) == 0);
+    size   = test_file_size(STORAGE_FILENAME);
+    before = malloc(size);
+    after  = malloc(size);
+    TEST_CHECK(before && after);
+    test_file_read(STORAGE_FILENAME, 0, before, size);
+
+    TEST_CHECK(test_boot(boot_abort_alice) == 0);
+    TEST_CHECK(test_file_size(STORAGE_FILENAME) == size);
+    test_file_read(STORAGE_FILENAME, 0, after, size);
+    TEST_CHECK(memcmp(before, after, size) == 0);
+    free(before);
+    free(after);
+
+    printf("test_user_txn_abort passes.\n");
+}
+
+void test_user_compact() {
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_provision) == 0);
+    TEST_CHECK(test_boot(boot_compact) == 0);
+    TEST_CHECK(test_boot(boot_find_carol) == 1);
+
+    printf("test_user_compact passes.\n");
+}
+
+void test_user_cache_invalidation() {
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_provision) == 0);
+    TEST_CHECK(test_boot(boot_cache_invalidation) == 0);
+
+    printf("test_user_cache_invalidation passes.\n");
+}
+
+void test_user_fill() {
+    test_wipe_storage();
+    TEST_CHECK(test_boot(boot_fill) == 0);
+    TEST_CHECK(test_boot(boot_refill_middle) == 1);
+
+    printf("test_user_fill passes.\n");
+}
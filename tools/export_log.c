@@ -0,0 +1,424 @@
+// Streams the audit log as CSV or JSON Lines for shipping to a SIEM.
+//
+//   export_log [--csv | --json]
+//
+// Reads the storage next to the executable, as the other binaries do:
+// sealed segments under LOG_SEGMENT_DIR in archive order, then the pages of
+// the live ring in LOG_STORAGE_FILENAME that are not archived yet. Files are
+// memory-mapped and split into pages (frames never cross one). Worker
+// threads decode and verify the pages, and the results are written in order.
+// Problems go to stderr, and the exit status is 1 if anything did not
+// verify. Seal numbering and the segment index are log_verify_segments' job.
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crypto/crypto.h"
+#include "global/common.h"
+#include "global/config.h"
+#include "logging/logging.h"
+
+#define EXPORT_BATCH_PAGES 64
+#define EXPORT_MAX_THREADS 16
+// Smallest frame: sync, length, delta and type bytes, then the tag
+#define EXPORT_PAGE_RECORDS (CONFIG_LOG_PAGE_SIZE / (4 + LOG_TAG_SIZE) + 1)
+
+typedef enum { EXPORT_CSV, EXPORT_JSON } export_format_t;
+
+typedef struct {
+    const uint8_t*     page;
+    uint32_t           slot;
+    uint32_t           expected_seq;  // 0 for ring pages, whose order is not known yet
+    status_t           status;
+    log_page_summary_t summary;
+    log_record_t*      records;
+    uint32_t           count;
+} export_page_t;
+
+typedef struct {
+    export_page_t* pages;
+    size_t         count;
+    atomic_size_t  next;
+} export_batch_t;
+
+typedef struct {
+    export_format_t format;
+    uint32_t        last_seq;                 // Page written last (0 = none)
+    uint8_t         last_tag[LOG_TAG_SIZE];   // Its final tag
+    bool            failed;
+} export_state_t;
+
+static const char* event_names[] = {
+    [EVENT_APPLICATION_START]   = "APPLICATION_START",
+    [EVENT_REQUEST_TO_UNLOCK]   = "REQUEST_TO_UNLOCK",
+    [EVENT_UNLOCKING_DEVICE]    = "UNLOCKING_DEVICE",
+    [EVENT_LOCKING_DEVICE]      = "LOCKING_DEVICE",
+    [EVENT_UNLOCK_CHECK_FAILED] = "UNLOCK_CHECK_FAILED",
+    [EVENT_REQUEST_PASS_CHANGE] = "REQUEST_PASS_CHANGE",
+    [EVENT_PASS_CHANGE_FAILED]  = "PASS_CHANGE_FAILED",
+    [EVENT_PASS_CHANGE_PASSED]  = "PASS_CHANGE_PASSED",
+    [EVENT_LOG_DISCARDED]       = "LOG_DISCARDED",
+};
+
+static const char* event_name(uint8_t type) {
+    if (type < sizeof(event_names) / sizeof(event_names[0]) && event_names[type]) {
+        return event_names[type];
+    }
+    return "CUSTOM";
+}
+
+static void build_executable_relative_path(char* out, const char* filename) {
+    char    base_path[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", base_path, sizeof(base_path) - 1);
+
+    if (len <= 0) {
+        snprintf(out, PATH_MAX, "%s", filename);
+        return;
+    }
+    base_path[len] = '\0';
+
+    char* last_slash = strrchr(base_path, '/');
+    if (last_slash) *(last_slash + 1) = '\0';
+    snprintf(out, PATH_MAX, "%s%s", base_path, filename);
+}
+
+// Read-only mapping of a whole file; NULL if it is missing or empty
+static const uint8_t* map_file(const char* path, size_t* out_size) {
+    struct stat st;
+    int         fd  = open(path, O_RDONLY | O_CLOEXEC);
+    void*       map = MAP_FAILED;
+
+    *out_size = 0;
+    if (fd < 0) return NULL;
+
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) *out_size = (size_t) st.st_size;
+    }
+    close(fd);
+
+    return (map == MAP_FAILED) ? NULL : (const uint8_t*) map;
+}
+
+static bool collect_record(const log_record_t* rec, void* ctx) {
+    export_page_t* job = (export_page_t*) ctx;
+
+    if (job->count < EXPORT_PAGE_RECORDS) {
+        job->records[job->count++] = *rec;
+    }
+    return true;
+}
+
+static void* export_worker(void* arg) {
+    export_batch_t* batch = (export_batch_t*) arg;
+
+    for (;;) {
+        size_t i = atomic_fetch_add(&batch->next, 1);
+        if (i >= batch->count) break;
+
+        export_page_t* job = &batch->pages[i];
+        job->status = log_decode_page(job->page, job->slot, collect_record, job, &job->summary);
+    }
+
+    return NULL;
+}
+
+// Decode every page of the batch on up to threads workers
+static bool run_batch(export_page_t* pages, size_t count, unsigned threads) {
+    export_batch_t batch = {.pages = pages, .count = count};
+    pthread_t      workers[EXPORT_MAX_THREADS];
+    unsigned       started = 0;
+
+    atomic_init(&batch.next, 0);
+    for (size_t i = 0; i < count; ++i) {
+        pages[i].records = calloc(EXPORT_PAGE_RECORDS, sizeof(log_record_t));
+        pages[i].count   = 0;
+        if (!pages[i].records) return false;
+    }
+
+    while (started < threads && started < count &&
+           pthread_create(&workers[started], NULL, export_worker, &batch) == 0) {
+        started++;
+    }
+    if (started == 0) export_worker(&batch);
+    for (unsigned i = 0; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+
+    return true;
+}
+
+static void print_record(const export_state_t* state, const log_record_t* rec) {
+    char payload[2 * LOG_MAX_PAYLOAD + 1];
+
+    for (size_t i = 0; i < rec->payload_len; ++i) {
+        snprintf(payload + 2 * i, 3, "%02x", rec->payload[i]);
+    }
+    payload[2 * rec->payload_len] = '\0';
+
+    if (state->format == EXPORT_JSON) {
+        printf("{\"timestamp\":%" PRIu32 ",\"type\":%u,\"event\":\"%s\",\"payload\":\"%s\"}\n",
+               rec->timestamp, rec->type, event_name(rec->type), payload);
+    } else {
+        printf("%" PRIu32 ",%u,%s,%s\n", rec->timestamp, rec->type, event_name(rec->type), payload);
+    }
+}
+
+// Write one decoded page, checking it against the page written before it
+static void emit_page(export_state_t* state, export_page_t* job) {
+    if (job->expected_seq != 0 && job->summary.seq != job->expected_seq) {
+        fprintf(stderr, "Page %" PRIu32 " is missing or out of place\n", job->expected_seq);
+        state->failed = true;
+    } else if (job->status != STATUS_OK && job->summary.seq == 0) {
+        fprintf(stderr, "Ring slot %" PRIu32 ": page header does not authenticate\n", job->slot);
+        state->failed = true;
+    } else if (job->status != STATUS_OK) {
+        fprintf(stderr, "Page %" PRIu32 ": %" PRIu32 " bytes did not authenticate\n",
+                job->summary.seq, job->summary.skipped);
+        state->failed = true;
+    }
+
+    if (job->summary.seq != 0 && state->last_seq != 0 && job->summary.seq == state->last_seq + 1 &&
+        secure_compare(job->summary.link, state->last_tag, LOG_TAG_SIZE) != STATUS_OK) {
+        fprintf(stderr, "Chain broken before page %" PRIu32 "\n", job->summary.seq);
+        state->failed = true;
+    }
+
+    for (uint32_t i = 0; i < job->count; ++i) {
+        print_record(state, &job->records[i]);
+    }
+
+    if (job->summary.seq != 0) {
+        state->last_seq = job->summary.seq;
+        memcpy(state->last_tag, job->summary.last, LOG_TAG_SIZE);
+    }
+
+    free(job->records);
+    job->records = NULL;
+}
+
+static int compare_segment_numbers(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*) a;
+    uint32_t y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
+
+static int compare_ring_pages(const void* a, const void* b) {
+    uint32_t x = ((const export_page_t*) a)->summary.seq;
+    uint32_t y = ((const export_page_t*) b)->summary.seq;
+    return (x > y) - (x < y);
+}
+
+// Sealed segments in archive order, EXPORT_BATCH_PAGES pages at a time
+static void export_segments(export_state_t* state, unsigned threads) {
+    char           dir_path[PATH_MAX];
+    DIR*           dir      = NULL;
+    uint32_t*      numbers  = NULL;
+    size_t         count    = 0;
+    size_t         capacity = 0;
+    export_page_t* pending  = calloc(EXPORT_BATCH_PAGES, sizeof(export_page_t));
+    size_t         queued   = 0;
+
+    build_executable_relative_path(dir_path, LOG_SEGMENT_DIR);
+    dir = opendir(dir_path);
+    if (!dir || !pending) {
+        if (dir) closedir(dir);
+        free(pending);
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        uint32_t number = 0;
+        char     suffix[8];
+
+        if (sscanf(entry->d_name, "%8" SCNx32 "%7s", &number, suffix) != 2 ||
+            strcmp(suffix, ".seg") != 0) {
+            continue;
+        }
+        if (count == capacity) {
+            capacity     = capacity ? 2 * capacity : 64;
+            uint32_t* grown = realloc(numbers, capacity * sizeof(*numbers));
+            if (!grown) break;
+            numbers = grown;
+        }
+        numbers[count++] = number;
+    }
+    closedir(dir);
+    qsort(numbers, count, sizeof(*numbers), compare_segment_numbers);
+
+    for (size_t n = 0; n < count; ++n) {
+        char               path[sizeof(dir_path) + sizeof("00000000.seg")];
+        size_t             size = 0;
+        log_segment_info_t info;
+
+        snprintf(path, sizeof(path), "%s%08" PRIx32 ".seg", dir_path, numbers[n]);
+        const uint8_t* map   = map_file(path, &size);
+        size_t         pages = size / CONFIG_LOG_PAGE_SIZE;
+        size_t         seal  = pages * CONFIG_LOG_PAGE_SIZE;
+
+        if (!map || log_segment_seal_check(map + seal, size - seal, &info) != STATUS_OK ||
+            info.segment != numbers[n] || info.pages != pages) {
+            fprintf(stderr, "Segment %08" PRIx32 ": seal does not verify, skipped\n", numbers[n]);
+            state->failed = true;
+            continue; // Mappings live until exit
+        }
+
+        for (uint32_t i = 0; i < info.pages; ++i) {
+            export_page_t* job = &pending[queued++];
+
+            memset(job, 0, sizeof(*job));
+            job->page         = map + (size_t) i * CONFIG_LOG_PAGE_SIZE;
+            job->expected_seq = info.first_seq + i;
+            job->slot         = (job->expected_seq - 1) % CONFIG_LOG_PAGE_COUNT;
+
+            if (queued == EXPORT_BATCH_PAGES || (n + 1 == count && i + 1 == info.pages)) {
+                if (!run_batch(pending, queued, threads)) {
+                    fprintf(stderr, "Out of memory\n");
+                    exit(1);
+                }
+                for (size_t j = 0; j < queued; ++j) {
+                    emit_page(state, &pending[j]);
+                }
+                queued = 0;
+            }
+        }
+    }
+
+    if (queued > 0 && run_batch(pending, queued, threads)) {
+        for (size_t j = 0; j < queued; ++j) {
+            emit_page(state, &pending[j]);
+        }
+    }
+
+    free(numbers);
+    free(pending);
+}
+
+// Live ring pages newer than anything already written, oldest first. The
+// ring has to continue the archive without a gap.
+static void export_ring(export_state_t* state, unsigned threads) {
+    char           path[PATH_MAX];
+    size_t         size = 0;
+    export_page_t  pages[CONFIG_LOG_PAGE_COUNT];
+    const uint8_t* map;
+
+    build_executable_relative_path(path, LOG_STORAGE_FILENAME);
+    map = map_file(path, &size);
+    if (!map || size < log_page_offset(CONFIG_LOG_PAGE_COUNT)) {
+        fprintf(stderr, "No log ring at %s\n", path);
+        state->failed = true;
+        return;
+    }
+
+    memset(pages, 0, sizeof(pages));
+    for (uint32_t slot = 0; slot < CONFIG_LOG_PAGE_COUNT; ++slot) {
+        pages[slot].page = map + log_page_offset(slot);
+        pages[slot].slot = slot;
+    }
+
+    if (!run_batch(pages, CONFIG_LOG_PAGE_COUNT, threads)) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+
+    qsort(pages, CONFIG_LOG_PAGE_COUNT, sizeof(pages[0]), compare_ring_pages);
+
+    // Slots without an authentic header sort first: report the damaged ones
+    uint32_t i = 0;
+    for (; i < CONFIG_LOG_PAGE_COUNT && pages[i].summary.seq == 0; ++i) {
+        if (pages[i].status != STATUS_OK) {
+            emit_page(state, &pages[i]);
+        } else {
+            free(pages[i].records);
+        }
+    }
+
+    // Every page from the last archived one (or the oldest the ring can
+    // still hold) up to the newest must be there. A blank or replaced slot
+    // in that range is a gap, not the end of the log.
+    uint32_t newest = pages[CONFIG_LOG_PAGE_COUNT - 1].summary.seq;
+    uint32_t head   = log_file_head_seq(map, size);
+    uint32_t first  = (newest > CONFIG_LOG_PAGE_COUNT) ? newest - CONFIG_LOG_PAGE_COUNT + 1 : 1;
+
+    if (state->last_seq != 0) {
+        first = state->last_seq + 1;
+    }
+
+    for (uint32_t seq = first; seq <= newest; ++seq) {
+        // Already exported from a segment, or older than the ring can hold
+        while (pages[i].summary.seq < seq) {
+            free(pages[i].records);
+            i++;
+        }
+        if (pages[i].summary.seq > seq) {
+            fprintf(stderr, "Pages %" PRIu32 "-%" PRIu32 " are missing\n", seq,
+                    pages[i].summary.seq - 1);
+            state->failed = true;
+            seq = pages[i].summary.seq;
+        }
+        emit_page(state, &pages[i++]);
+    }
+
+    for (; i < CONFIG_LOG_PAGE_COUNT; ++i) {
+        free(pages[i].records);
+    }
+
+    // The checkpoint knows the head even when its page header is gone
+    if (head > newest && head >= first) {
+        uint32_t from = (newest + 1 > first) ? newest + 1 : first;
+
+        fprintf(stderr, "Pages %" PRIu32 "-%" PRIu32 " are missing\n", from, head);
+        state->failed = true;
+    }
+}
+
+int main(int argc, char** argv) {
+    export_state_t state = {.format = EXPORT_CSV};
+    uint8_t        mac[LOCKSYS_HASH_SIZE];
+    long           cpus    = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned       threads = (cpus < 1) ? 1 : (cpus > EXPORT_MAX_THREADS) ? EXPORT_MAX_THREADS
+                                                                          : (unsigned) cpus;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--json") == 0) {
+            state.format = EXPORT_JSON;
+        } else if (strcmp(argv[i], "--csv") == 0) {
+            state.format = EXPORT_CSV;
+        } else {
+            fprintf(stderr, "usage: %s [--csv | --json]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // Derive the device-key schedule once, before the workers share it
+    if (compute_internal_hmac(mac, 0, mac, sizeof(mac)) != STATUS_OK) {
+        fprintf(stderr, "Failed to load the device key\n");
+        return 1;
+    }
+
+    if (state.format == EXPORT_CSV) {
+        printf("timestamp,type,event,payload\n");
+    }
+
+#if CONFIG_LOG_SEGMENT_PAGES > 0
+    export_segments(&state, threads);
+#endif
+    export_ring(&state, threads);
+
+    crypto_release_internal_key();
+    fflush(stdout);
+
+    return state.failed ? 1 : 0;
+}